@@ -0,0 +1,382 @@
+#include "pgfplotter"
+#include "compile.hpp"
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <thread>
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+
+namespace
+{
+    enum class JobState
+    {
+        Queued, Generating, Cancelled, Compiling, Done
+    };
+}
+
+struct pgfplotter::AsyncJob
+{
+    const std::string path;
+    std::vector<Axis> axes;
+    const PlotOptions options;
+    std::promise<void> promise;
+    const std::shared_future<void> future;
+    // Guarded by the queue mutex.
+    JobState state = JobState::Queued;
+
+    AsyncJob(const std::string& path, std::vector<Axis>&& axes, const
+        PlotOptions& options) : path(path), axes(std::move(axes)), options(
+        options), future(promise.get_future().share())
+    {
+        for(auto& n : this->axes)
+        {
+            n.own_values();
+        }
+    }
+
+    void run();
+
+    PlotError cancelled() const
+    {
+        return PlotError("Cancelled plot \"" + output_name(path, options) +
+            "\".");
+    }
+};
+
+namespace
+{
+    class AsyncQueue
+    {
+        std::mutex mutex;
+        std::condition_variable workAvailable;
+        std::condition_variable spaceAvailable;
+        std::condition_variable idle;
+        std::deque<std::shared_ptr<pgfplotter::AsyncJob>> pending;
+        std::size_t capacity = 16;
+        // Workers wanted and running. Workers are detached and leave once
+        // there are more than wanted, after finishing their current plot, so
+        // the count can be changed from anywhere, including a plot.
+        unsigned int numWorkers = 1;
+        unsigned int numThreads = 0;
+        std::size_t running = 0;
+        bool stopping = false;
+
+        void work()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while(true)
+            {
+                workAvailable.wait(lock, [&]()
+                {
+                    return stopping || numThreads > numWorkers || !pending.
+                        empty();
+                });
+                if(stopping || numThreads > numWorkers)
+                {
+                    --numThreads;
+                    return;
+                }
+                const auto job = pending.front();
+                pending.pop_front();
+                job->state = JobState::Generating;
+                ++running;
+                spaceAvailable.notify_one();
+
+                lock.unlock();
+                job->run();
+                lock.lock();
+
+                job->state = JobState::Done;
+                --running;
+                if(pending.empty() && !running)
+                {
+                    idle.notify_all();
+                }
+            }
+        }
+
+        // Starts workers until there are as many as wanted. Expects the mutex
+        // to be held.
+        void add_workers()
+        {
+            for(; numThreads < numWorkers; ++numThreads)
+            {
+                std::thread(&AsyncQueue::work, this).detach();
+            }
+        }
+
+    public:
+        // Cancels the pending plots and lets idle workers leave, for exit.
+        // Plots still rendering aren't waited for.
+        void shut_down()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            stopping = true;
+            workAvailable.notify_all();
+            lock.unlock();
+            cancel_all();
+        }
+
+        void push(const std::shared_ptr<pgfplotter::AsyncJob>& job)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            spaceAvailable.wait(lock, [&]()
+            {
+                return pending.size() < capacity;
+            });
+            if(stopping)
+            {
+                throw std::runtime_error("Cannot queue plot \"" + output_name(
+                    job->path, job->options) + "\" during exit.");
+            }
+            pending.push_back(job);
+            add_workers();
+            workAvailable.notify_one();
+        }
+
+        // Called by a job once its source has been generated. Returns false if
+        // the job was cancelled in the meantime.
+        bool begin_compile(pgfplotter::AsyncJob& job)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(job.state != JobState::Generating)
+            {
+                return false;
+            }
+            job.state = JobState::Compiling;
+            return true;
+        }
+
+        bool cancel(const std::shared_ptr<pgfplotter::AsyncJob>& job)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if(job->state == JobState::Generating || job->state == JobState::
+                Cancelled)
+            {
+                // The worker notices at `begin_compile` and fails the job.
+                job->state = JobState::Cancelled;
+                return true;
+            }
+            if(job->state != JobState::Queued)
+            {
+                return false;
+            }
+            pending.erase(std::find(pending.begin(), pending.end(), job));
+            job->state = JobState::Done;
+            spaceAvailable.notify_one();
+            if(pending.empty() && !running)
+            {
+                idle.notify_all();
+            }
+            lock.unlock();
+            job->promise.set_exception(std::make_exception_ptr(job->
+                cancelled()));
+            return true;
+        }
+
+        void cancel_all()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            std::deque<std::shared_ptr<pgfplotter::AsyncJob>> cancelled;
+            cancelled.swap(pending);
+            for(auto& n : cancelled)
+            {
+                n->state = JobState::Done;
+            }
+            spaceAvailable.notify_all();
+            if(!running)
+            {
+                idle.notify_all();
+            }
+            lock.unlock();
+            for(auto& n : cancelled)
+            {
+                n->promise.set_exception(std::make_exception_ptr(n->
+                    cancelled()));
+            }
+        }
+
+        void wait_all()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            idle.wait(lock, [&]()
+            {
+                return pending.empty() && !running;
+            });
+        }
+
+        void set_capacity(std::size_t n)
+        {
+            if(!n)
+            {
+                throw std::runtime_error("Async queue size must be positive.");
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            capacity = n;
+            spaceAvailable.notify_all();
+        }
+
+        void set_workers(unsigned int n)
+        {
+            if(!n)
+            {
+                throw std::runtime_error("Number of async workers must be posi"
+                    "tive.");
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            numWorkers = n;
+            // Extra workers leave once idle.
+            workAvailable.notify_all();
+            if(!pending.empty())
+            {
+                add_workers();
+            }
+        }
+    };
+}
+
+// Never destroyed, as workers may still be using it during static
+// destruction. Pending plots are dropped at exit instead, by a handler
+// registered before any worker starts.
+static AsyncQueue& queue()
+{
+    static AsyncQueue& q = []() -> AsyncQueue&
+    {
+        AsyncQueue* q = new AsyncQueue;
+        std::atexit([]()
+        {
+            queue().shut_down();
+        });
+        return *q;
+    }();
+    return q;
+}
+
+void pgfplotter::AsyncJob::run()
+{
+    try
+    {
+        if(axes.empty())
+        {
+            throw PlotError("No plots provided for \"" + output_name(path,
+                options) + "\".");
+        }
+        std::vector<const Axis*> ptrs;
+        ptrs.reserve(axes.size());
+        for(const auto& n : axes)
+        {
+            ptrs.push_back(&n);
+        }
+        if(options.preview)
+        {
+            if(!queue().begin_compile(*this))
+            {
+                throw cancelled();
+            }
+            print_warnings(render_preview(path, ptrs, options));
+            promise.set_value();
+            return;
+        }
+        PlotStats stats;
+        const std::string src = Axis::document_src(path, ptrs, options,
+            stats);
+        if(!queue().begin_compile(*this))
+        {
+            std::filesystem::remove_all(scratch_path(path, options) + Suffix);
+            throw cancelled();
+        }
+        compile(path, src, options, std::move(stats), false);
+        promise.set_value();
+    }
+    catch(...)
+    {
+        promise.set_exception(std::current_exception());
+    }
+}
+
+bool pgfplotter::PlotHandle::valid() const
+{
+    return static_cast<bool>(job);
+}
+
+bool pgfplotter::PlotHandle::ready() const
+{
+    if(!job)
+    {
+        throw std::runtime_error("Plot handle is empty.");
+    }
+    return job->future.wait_for(std::chrono::seconds(0)) == std::
+        future_status::ready;
+}
+
+void pgfplotter::PlotHandle::wait() const
+{
+    if(!job)
+    {
+        throw std::runtime_error("Plot handle is empty.");
+    }
+    job->future.wait();
+}
+
+void pgfplotter::PlotHandle::get() const
+{
+    if(!job)
+    {
+        throw std::runtime_error("Plot handle is empty.");
+    }
+    job->future.get();
+}
+
+bool pgfplotter::PlotHandle::cancel()
+{
+    if(!job)
+    {
+        throw std::runtime_error("Plot handle is empty.");
+    }
+    return queue().cancel(job);
+}
+
+pgfplotter::PlotHandle pgfplotter::plot_async(const std::string& path, std::
+    vector<Axis> axes, const PlotOptions& options)
+{
+    auto job = std::make_shared<AsyncJob>(path, std::move(axes), options);
+    queue().push(job);
+    return PlotHandle(job);
+}
+
+pgfplotter::PlotHandle pgfplotter::plot_async(const std::string& path, const
+    std::vector<const Axis*>& ptrs, const PlotOptions& options)
+{
+    std::vector<Axis> axes;
+    axes.reserve(ptrs.size());
+    for(const auto& n : ptrs)
+    {
+        axes.push_back(*n);
+    }
+    auto job = std::make_shared<AsyncJob>(path, std::move(axes), options);
+    queue().push(job);
+    return PlotHandle(job);
+}
+
+void pgfplotter::set_async_queue_size(std::size_t n)
+{
+    queue().set_capacity(n);
+}
+
+void pgfplotter::set_async_workers(unsigned int n)
+{
+    queue().set_workers(n);
+}
+
+void pgfplotter::wait_all()
+{
+    queue().wait_all();
+}
+
+void pgfplotter::cancel_all()
+{
+    queue().cancel_all();
+}
@@ -1,156 +1,22 @@
 #include "pgfplotter"
-#include "detect_os.hpp"
+#include "compile.hpp"
+#include "table_writer.hpp"
+#include "parallel.hpp"
+#include "decimate.hpp"
+#include "contour.hpp"
 #include <iostream>
 #include <sstream>
 #include <iomanip>
 #include <cmath>
-#include <fstream>
 #include <algorithm>
-#include <filesystem>
-#ifdef OS_WINDOWS
-#include <windows.h>
-#else
-#include <unistd.h>
-#include <sys/wait.h>
-#include <sys/fcntl.h>
-#include <cstring>
-#endif
-
-#ifdef OS_WINDOWS
-static void system_call(const std::string& file, const std::vector<std::string>&
-    args)
-{
-    std::string cmd = file;
-    for(const auto& n : args)
-    {
-        cmd += " \"" + n + "\"";
-    }
-    STARTUPINFOA si = {};
-    si.cb = sizeof(si);
-    si.dwFlags = STARTF_USESHOWWINDOW;
-    si.wShowWindow = SW_HIDE;
-    SECURITY_ATTRIBUTES sa = {};
-    sa.nLength = sizeof(sa);
-    sa.bInheritHandle = true;
-    sa.lpSecurityDescriptor = nullptr;
-    HANDLE g_hChildStd_IN_Rd = nullptr;
-    HANDLE g_hChildStd_IN_Wr = nullptr;
-    HANDLE g_hChildStd_OUT_Rd = nullptr;
-    HANDLE g_hChildStd_OUT_Wr = nullptr;
-    if(!CreatePipe(&g_hChildStd_OUT_Rd, &g_hChildStd_OUT_Wr, &sa, 0))
-    {
-        throw std::runtime_error("Failed to create output pipe: Error " + std::
-            to_string(GetLastError()) + ".");
-    }
-    if(!SetHandleInformation(g_hChildStd_OUT_Rd, HANDLE_FLAG_INHERIT, 0))
-    {
-        throw std::runtime_error("Failed to set output pipe to inherit: Error "
-            + std::to_string(GetLastError()) + ".");
-    }
-    if(!CreatePipe(&g_hChildStd_IN_Rd, &g_hChildStd_IN_Wr, &sa, 0))
-    {
-        throw std::runtime_error("Failed to create input pipe: Error " + std::
-            to_string(GetLastError()) + ".");
-    }
-    if(!SetHandleInformation(g_hChildStd_IN_Wr, HANDLE_FLAG_INHERIT, 0))
-    {
-        throw std::runtime_error("Failed to set input pipe to inherit: Error " +
-            std::to_string(GetLastError()) + ".");
-    }
-    si.hStdError = g_hChildStd_OUT_Wr;
-    si.hStdOutput = g_hChildStd_OUT_Wr;
-    si.hStdInput = g_hChildStd_IN_Rd;
-    si.dwFlags |= STARTF_USESTDHANDLES;
-    PROCESS_INFORMATION pi;
-    if(!CreateProcessA(nullptr, const_cast<char*>(cmd.c_str()), nullptr,
-        nullptr, true, CREATE_NO_WINDOW, nullptr, nullptr, &si, &pi))
-    {
-        throw std::runtime_error("Failed to create process: Error " + std::
-            to_string(GetLastError()) + ".");
-    }
-    WaitForSingleObject(pi.hProcess, INFINITE);
-    DWORD exitCode;
-    if(!GetExitCodeProcess(pi.hProcess, &exitCode))
-    {
-        throw std::runtime_error("Failed to get exit code: Error " + std::
-            to_string(GetLastError()) + ".");
-    }
-    if(exitCode == STILL_ACTIVE)
-    {
-        throw std::runtime_error("Wait returned before process completed.");
-    }
-    if(exitCode)
-    {
-        throw std::runtime_error("System call returned " + std::to_string(
-            exitCode) + ".");
-    }
-    CloseHandle(pi.hProcess);
-    CloseHandle(pi.hThread);
-    CloseHandle(g_hChildStd_OUT_Wr);
-    g_hChildStd_OUT_Wr = nullptr;
-    CloseHandle(g_hChildStd_IN_Rd);
-    g_hChildStd_OUT_Wr = nullptr;
-}
-#else
-static void system_call(const std::string& file, const std::vector<std::string>&
-    args)
-{
-    const auto pid = fork();
-    if(pid > 0)
-    {
-        int status;
-        if(waitpid(pid, &status, 0) < 0)
-        {
-            throw std::runtime_error("Wait failed.");
-        }
-        if(!WIFEXITED(status))
-        {
-            throw std::runtime_error("System call did not exit normally.");
-        }
-        const auto exitCode = WEXITSTATUS(status);
-        if(exitCode)
-        {
-            throw std::runtime_error("System call returned " + std::to_string(
-                exitCode) + ".");
-        }
-    }
-    else if(pid == 0)
-    {
-        std::vector<const char*> argv = {file.c_str()};
-        for(const auto& n : args)
-        {
-            argv.push_back(n.c_str());
-        }
-        argv.push_back(nullptr);
-        const auto fd = open("/dev/null", O_WRONLY);
-        if(fd < 0)
-        {
-            std::cerr << "Warning: Failed to open \"/dev/null\": " << std::
-                strerror(errno) << std::endl;
-        }
-        else
-        {
-            dup2(fd, 1);
-            dup2(fd, 2);
-            close(fd);
-        }
-        const int status = execvp(argv[0], const_cast<char**>(argv.data()));
-        std::exit(status);
-    }
-    else
-    {
-        throw std::runtime_error("Fork failed: " + std::string(std::strerror(
-            errno)) + ".");
-    }
-}
-#endif
+#include <chrono>
+#include <charconv>
+#include <cstdio>
 
 static const std::string FontSize = "footnotesize";
 static const std::string LegendFontSize = "scriptsize";
 static const std::string TitleSize = "normalsize";
 
-static const std::string Suffix = "_plot_data";
-
 static std::string convert_marker(char marker)
 {
     if(marker <= 0)
@@ -193,148 +59,74 @@ static const std::string endl = "\n";
 // Convert numbers to strings without sacrificing precision.
 std::string pgfplotter::Axis::ToString(double x, unsigned int precision)
 {
+    char buf[64];
+    if(char* end = format_double(buf, buf + sizeof(buf), x, precision))
+    {
+        return std::string(buf, end);
+    }
     std::stringstream ss;
     ss << std::setprecision(precision) << x;
     return ss.str();
 }
 
-// Extract directories from path.
-static void split_path(const std::string& path, std::string& dir, std::string&
-    name)
-{
-    const std::filesystem::path p(path);
-    dir = p.parent_path().string();
-    name = p.filename().string();
-}
-
-// Write LuaLaTeX to a temporary file, compile and clean up.
-static void compile(const std::string& path, const std::string& src, bool
-    deleteData)
+namespace
 {
-    if(path.find('"') != std::string::npos)
+    // A double formatted like `std::to_string` does, with six decimals.
+    struct FixedPoint
     {
-        throw std::runtime_error("Plot path cannot contain double quote charact"
-            "er.");
-    }
+        double x;
+    };
 
-    std::string dir;
-    std::string name;
-    split_path(path, dir, name);
-
-    if(name.find('\t') != std::string::npos || name.find(' ') != std::string::
-        npos)
+    // Appends to TeX source, formatting numbers in place rather than through
+    // temporary strings.
+    class SourceWriter
     {
-        throw std::runtime_error("Plot name cannot contain whitespace.");
-    }
+        std::string& src;
 
-    {
-        const std::string texPath = path + Suffix + "/" + name + ".tex";
-        std::ofstream out(texPath);
-        if(!out)
-        {
-            throw std::runtime_error("Unable to open output file \"" + texPath +
-                "\".");
-        }
-        out << src << std::endl;
-    }
+    public:
+        explicit SourceWriter(std::string& src) : src(src) {}
 
-    {
-        const std::string makefilePath = path + Suffix + "/Makefile";
-        std::ofstream out(makefilePath);
-        if(!out)
+        SourceWriter& operator<<(const std::string& s)
         {
-            throw std::runtime_error("Unable to open output file \"" +
-                makefilePath + "\".");
+            src += s;
+            return *this;
         }
-        out << "print-% : ; @echo $* = $($*)" << std::endl << std::endl;
-        out << name << ".png: export TERM = dumb" << std::endl;
-        out << name << ".png: " << name << ".pdf" << std::endl;
-        out << "\tpdftoppm -png -r 300 " << name << ".pdf > " << name << ".png "
-            "\\" << std::endl;
-        out << "\t    && $(RM) " << name << ".pdf" << std::endl;
-        out << std::endl;
-        out << "ifeq ($(OS), Windows_NT)" << std::endl;
-        out << name << ".pdf: " << name << ".ps" << std::endl;
-        out << "\tMSYS2_ARG_CONV_EXCL=\"*\" ps2pdf14 -dPDFSETTINGS=/prepress "
-            << name << ".ps " << name << ".pdf \\" << std::endl;
-        out << "\t    && $(RM) " << name << ".ps" << std::endl;
-        out << "else" << std::endl;
-        out << name << ".pdf: " << name << ".ps" << std::endl;
-        out << "\tps2pdf14 -dPDFSETTINGS=/prepress " << name << ".ps " << name
-            << ".pdf \\" << std::endl;
-        out << "\t    && $(RM) " << name << ".ps" << std::endl;
-        out << "endif" << std::endl;
-        out << std::endl;
-        out << name << ".ps: " << name << ".tex $(wildcard *.data) $(wildcard "
-            "*.surf)" << std::endl;
-        out << "\tlualatex -halt-on-error -shell-escape -interaction=batchmode "
-            << name << " \\" << std::endl;
-        out << "\t    && mv " << name << ".pdf " << name << "_unpressed.pdf \\"
-            << std::endl;
-        out << "\t    && $(RM) " << name << ".aux \\" << std::endl;
-        out << "\t    && $(RM) " << name << ".log \\" << std::endl;
-        out << "\t    && $(RM) " << name << "_contortmp*.dat \\" << std::endl;
-        out << "\t    && $(RM) " << name << "_contortmp*.script \\" << std::
-            endl;
-        out << "\t    && $(RM) " << name << "_contortmp*.table \\" << std::endl;
-        out << "\t    && pdf2ps " << name << "_unpressed.pdf \\" << std::endl;
-        out << "\t    && mv " << name << "_unpressed.ps " << name << ".ps \\" <<
-            std::endl;
-        out << "\t    && $(RM) " << name << "_unpressed.pdf" << std::endl;
-    }
-
-    try
-    {
-        system_call("make", {"-C", path + Suffix});
-    }
-    catch(const std::exception& e)
-    {
-        std::cerr << "Warning: Failed to plot \"" << name << ".png\": " << e.
-            what() << std::endl;
-        return;
-    }
-
-    try
-    {
-        const std::string pngPath = path + Suffix + "/" + name + ".png";
-        const std::string newPath = (dir.empty() ? "." : dir) + "/" + name +
-            ".png";
-        std::filesystem::rename(pngPath, newPath);
-    }
-    catch(const std::exception& e)
-    {
-        std::cerr << "Warning: Failed to move \"" << name << ".png\": " << e.
-            what() << std::endl;
-        return;
-    }
-
-    std::cout << "Plotted \"" << path << ".png\"" << std::endl;
-
-    if(deleteData)
-    {
-        try
+        SourceWriter& operator<<(const char* s)
         {
-            std::filesystem::remove_all(path + Suffix);
+            src += s;
+            return *this;
         }
-        catch(const std::exception& e)
+        // As `Axis::ToString`.
+        SourceWriter& operator<<(double x)
         {
-            std::cerr << "Warning: Failed to delete plot data for \"" << path <<
-                "\": " << e.what() << std::endl;
+            char buf[64];
+            if(char* end = pgfplotter::format_double(buf, buf + sizeof(buf), x))
+            {
+                src.append(buf, end);
+            }
+            else
+            {
+                src += pgfplotter::Axis::ToString(x);
+            }
+            return *this;
         }
-    }
-    else
-    {
-        try
+        SourceWriter& operator<<(FixedPoint x)
         {
-            system_call("zip", {"-jqr", path + Suffix + ".zip", path + Suffix});
-            std::filesystem::remove_all(path + Suffix);
+            char buf[512];
+            const int size = std::snprintf(buf, sizeof(buf), "%f", x.x);
+            src.append(buf, std::min<std::size_t>(std::max(size, 0), sizeof(
+                buf) - 1));
+            return *this;
         }
-        catch(const std::exception& e)
+        template<typename T, std::enable_if_t<std::is_integral_v<T>>* =
+            nullptr>
+        SourceWriter& operator<<(T n)
         {
-            std::cerr << "Warning: Failed to archive and clean up plot data for"
-                " \"" << path << "\": " << e.what() << std::endl;
+            char buf[24];
+            src.append(buf, std::to_chars(buf, buf + sizeof(buf), n).ptr);
+            return *this;
         }
-    }
+    };
 }
 
 // Preamble
@@ -444,6 +236,12 @@ static const std::string src9 = []()
         oss << "}}\n";
         return oss.str();
     }();
+const std::string& pgfplotter::preamble_src()
+{
+    static const std::string src = src0 + src9;
+    return src;
+}
+
 static const std::string src2a = "\\begin{document}" + endl +
     "\\begin{tikzpicture}[define rgb/.code = {\\definecolor{mycolor}{RGB}{#1}},"
         " rgb color/.style = {define rgb = {#1}, mycolor}]" + endl +
@@ -488,11 +286,25 @@ void pgfplotter::Axis::setWLabel(const std::string& wLabel)
     setZLabel(wLabel); //TEMP - separate z & w
 }
 
-void pgfplotter::Axis::draw(const DrawStyle& style, const std::vector<double>&
-    x, const std::vector<double>& y, const std::vector<double>& z, const std::
-    vector<double>& w, const std::string& name)
+std::vector<pgfplotter::ArrayView> pgfplotter::Axis::Column::segments() const
 {
-    data.push_back({x, y, z, w});
+    if(!chunks)
+    {
+        return {ArrayView(data(), size())};
+    }
+    std::vector<ArrayView> s;
+    for(std::size_t i = 0; i < chunks->size; i += SeriesChunks::ChunkSize)
+    {
+        s.emplace_back(chunks->columns[index][i/SeriesChunks::ChunkSize].get(),
+            std::min(SeriesChunks::ChunkSize, chunks->size - i));
+    }
+    return s;
+}
+
+void pgfplotter::Axis::add_series(const DrawStyle& style, Column x, Column y,
+    Column z, Column w, const std::string& name)
+{
+    data.push_back({std::move(x), std::move(y), std::move(z), std::move(w)});
     markers.push_back(style.markStyle);
     names.push_back(name);
     colors.push_back(style.color);
@@ -501,38 +313,123 @@ void pgfplotter::Axis::draw(const DrawStyle& style, const std::vector<double>&
     opacities.push_back(style.opacity);
 }
 
+void pgfplotter::Axis::add_surface(Column x, Column y, Column z, unsigned int
+    contours, bool matrix, const std::string& name)
+{
+    surfaceX.push_back(std::move(x));
+    surfaceY.push_back(std::move(y));
+    surfaceZ.push_back(std::move(z));
+    numContours.push_back(contours);
+    names.push_back(name);
+    matrixSurf.push_back(matrix);
+    gridSizes.emplace_back();
+}
+
+void pgfplotter::Axis::draw(const DrawStyle& style, const std::vector<double>&
+    x, const std::vector<double>& y, const std::vector<double>& z, const std::
+    vector<double>& w, const std::string& name)
+{
+    add_series(style, x, y, z, w, name);
+}
+
+void pgfplotter::Axis::draw(const DrawStyle& style, std::vector<double>&& x,
+    std::vector<double>&& y, std::vector<double>&& z, std::vector<double>&& w,
+    const std::string& name)
+{
+    add_series(style, std::move(x), std::move(y), std::move(z), std::move(w),
+        name);
+}
+
+void pgfplotter::Axis::draw(const DrawStyle& style, ArrayView x, ArrayView y,
+    ArrayView z, ArrayView w, const std::string& name)
+{
+    add_series(style, x, y, z, w, name);
+}
+
+pgfplotter::Series pgfplotter::Axis::series(const DrawStyle& style, bool is3D,
+    bool hasMeta, const std::string& name)
+{
+    auto chunks = std::make_shared<SeriesChunks>();
+    chunks->is3D = is3D;
+    chunks->hasMeta = hasMeta;
+    add_series(style, Column(chunks, 0), Column(chunks, 1), is3D ? Column(
+        chunks, 2) : Column(), hasMeta ? Column(chunks, 3) : Column(), name);
+    return Series(chunks);
+}
+
 void pgfplotter::Axis::surf(const std::vector<double>& x, const std::vector<
     double>& y, const std::vector<double>& z, const std::string& name)
 {
-    surfaceX.push_back(x);
-    surfaceY.push_back(y);
-    surfaceZ.push_back(z);
-    numContours.push_back(0);
-    names.push_back(name);
-    matrixSurf.push_back(false);
+    add_surface(x, y, z, 0, false, name);
+}
+
+void pgfplotter::Axis::surf(std::vector<double>&& x, std::vector<double>&& y,
+    std::vector<double>&& z, const std::string& name)
+{
+    add_surface(std::move(x), std::move(y), std::move(z), 0, false, name);
+}
+
+void pgfplotter::Axis::surf(ArrayView x, ArrayView y, ArrayView z, const std::
+    string& name)
+{
+    add_surface(x, y, z, 0, false, name);
 }
 
 void pgfplotter::Axis::contour(const std::vector<double>& x, const std::vector<
     double>& y, const std::vector<double>& z, unsigned int contours, const std::
     string& name)
 {
-    surfaceX.push_back(x);
-    surfaceY.push_back(y);
-    surfaceZ.push_back(z);
-    numContours.push_back(contours);
-    names.push_back(name);
-    matrixSurf.push_back(false);
+    add_surface(x, y, z, contours, false, name);
+}
+
+void pgfplotter::Axis::contour(std::vector<double>&& x, std::vector<double>&& y,
+    std::vector<double>&& z, unsigned int contours, const std::string& name)
+{
+    add_surface(std::move(x), std::move(y), std::move(z), contours, false,
+        name);
+}
+
+void pgfplotter::Axis::contour(ArrayView x, ArrayView y, ArrayView z, unsigned
+    int contours, const std::string& name)
+{
+    add_surface(x, y, z, contours, false, name);
 }
 
 void pgfplotter::Axis::matrix(const std::vector<double>& x, const std::vector<
     double>& y, const std::vector<double>& z, const std::string& name)
 {
-    surfaceX.push_back(x);
-    surfaceY.push_back(y);
-    surfaceZ.push_back(z);
-    numContours.push_back(0);
-    names.push_back(name);
-    matrixSurf.push_back(true);
+    add_surface(x, y, z, 0, true, name);
+}
+
+void pgfplotter::Axis::matrix(std::vector<double>&& x, std::vector<double>&& y,
+    std::vector<double>&& z, const std::string& name)
+{
+    add_surface(std::move(x), std::move(y), std::move(z), 0, true, name);
+}
+
+void pgfplotter::Axis::matrix(ArrayView x, ArrayView y, ArrayView z, const std::
+    string& name)
+{
+    add_surface(x, y, z, 0, true, name);
+}
+
+void pgfplotter::Axis::setGridSize(std::size_t maxX, std::size_t maxY,
+    Pooling pooling)
+{
+    if(gridSizes.empty())
+    {
+        throw std::runtime_error("No surface to set the grid size of.");
+    }
+    gridSizes.back() = {false, maxX, maxY, pooling};
+}
+
+void pgfplotter::Axis::setGridSize(Pooling pooling)
+{
+    if(gridSizes.empty())
+    {
+        throw std::runtime_error("No surface to set the grid size of.");
+    }
+    gridSizes.back() = {true, 0, 0, pooling};
 }
 
 void pgfplotter::Axis::fill(const std::array<int, 3>& color, const std::vector<
@@ -739,6 +636,11 @@ void pgfplotter::Axis::noSep()
     _noSep = true;
 }
 
+void pgfplotter::Axis::decimate()
+{
+    _decimate = true;
+}
+
 void pgfplotter::Axis::setXTicks(const std::vector<double>& locations, const
     std::vector<std::string>& labels, bool rotate)
 {
@@ -771,114 +673,85 @@ void pgfplotter::Axis::bidirColormap()
     _bidirColormap = true;
 }
 
-std::string pgfplotter::Axis::plot_src(const std::string& path, int subplot) const
+void pgfplotter::Axis::plot_src(std::string& out, const std::string& path,
+    int subplot, const PlotOptions& options, PlotStats::SubplotStats& stats)
+    const
 {
-    if(path.empty())
-    {
-        throw std::runtime_error("Plot name is empty.");
-    }
-
-    std::string dir;
-    {
-        std::string tempName;
-        split_path(path, dir, tempName);
-    }
-
-    try
-    {
-        if(std::filesystem::exists(path + Suffix))
-        {
-            if(!std::filesystem::is_directory(path + Suffix))
-            {
-                throw std::runtime_error("Path already exists but is not a dire"
-                    "ctory.");
-            }
-        }
-        else
-        {
-            std::filesystem::create_directory(path + Suffix);
-        }
-    }
-    catch(const std::exception& e)
-    {
-        throw std::runtime_error("Failed to create plot data directory \"" +
-            path + Suffix + "\": " + e.what());
-    }
-
-    std::string src = "\\nextgroupplot[width = " + ToString(relWidth) + "\\text"
-        "width, height = " + ToString(relHeight) + "\\textwidth, colormap name "
-        "= ";
-    src += _bidirColormap ? "bidir" : "viridis";
-    src += ", every axis plot/.append style = {ultra thick, line join = bevel, "
-        "mark options = {line join = miter}}, view = {" + ToString(_viewAngles[
-        0]) + "}{" + ToString(_viewAngles[1]) + "}, clip mode = individual, col"
-        "orbar style = {font = \\" + FontSize + ", y tick label style = {";
+    SourceWriter src(out);
+    src << "\\nextgroupplot[width = " << relWidth << "\\textwidth, height = "
+        << relHeight << "\\textwidth, colormap name = " << (_bidirColormap ?
+        "bidir" : "viridis") << ", every axis plot/.append style = {ultra thic"
+        "k, line join = bevel, mark options = {line join = miter}}, view = {" <<
+        _viewAngles[0] << "}{" << _viewAngles[1] << "}, clip mode = individual"
+        ", colorbar style = {font = \\" << FontSize << ", y tick label style ="
+        " {";
     if(zPrecision >= 0)
     {
-        src += ", /pgf/number format/precision = " + ToString(zPrecision) +
-            ", /pgf/number format/zerofill";
+        src << ", /pgf/number format/precision = " << zPrecision << ", /pgf/nu"
+            "mber format/zerofill";
     }
     if(zFormat)
     {
-        src += ", scaled y ticks = false";
+        src << ", scaled y ticks = false";
     }
     if(zFormat == Fixed)
     {
-        src += ", /pgf/number format/fixed, /pgf/number format/fixed zerofill ="
+        src << ", /pgf/number format/fixed, /pgf/number format/fixed zerofill ="
             " true";
     }
     else if(zFormat == Sci)
     {
-        src += ", /pgf/number format/sci";
+        src << ", /pgf/number format/sci";
     }
-    src += "}, label style = {font = \\" + FontSize + "}, ylabel near ticks";
+    src << "}, label style = {font = \\" << FontSize << "}, ylabel near tic"
+        "ks";
     if(!_zLabel.empty())
     {
-        src += ", ylabel = {" + _zLabel + "}";
+        src << ", ylabel = {" << _zLabel << "}";
     }
-    src += "}";
+    src << "}";
 
     if(xLog)
     {
-        src += ", xmode = log";
+        src << ", xmode = log";
     }
     if(yLog)
     {
-        src += ", ymode = log";
+        src << ", ymode = log";
     }
     if(zLog)
     {
-        src += ", zmode = log";
+        src << ", zmode = log";
     }
 
     if(xSpacing)
     {
-        src += ", x coord trafo/.code = {\\pgfluamathparse{\\pgfmathresult/" +
-            ToString(xSpacing) +"}}, x coord inv trafo/.code = {\\pgfluamathpa"
-            "rse{\\pgfmathresult*" + ToString(xSpacing) + "}}";
+        src << ", x coord trafo/.code = {\\pgfluamathparse{\\pgfmathresult/"
+            << xSpacing << "}}, x coord inv trafo/.code = {\\pgfluamathparse{"
+            "\\pgfmathresult*" << xSpacing << "}}";
     }
     else if(xOffset)
     {
-        src += ", x coord trafo/.code = {\\pgfluamathparse{\\pgfmathresult - " +
-            ToString(xOffset) +"}}, x coord inv trafo/.code = {\\pgfluamathpa"
-            "rse{\\pgfmathresult + " + ToString(xOffset) + "}}";
+        src << ", x coord trafo/.code = {\\pgfluamathparse{\\pgfmathresult -"
+            " " << xOffset << "}}, x coord inv trafo/.code = {\\pgfluamathpars"
+            "e{\\pgfmathresult + " << xOffset << "}}";
     }
     if(ySpacing)
     {
-        src += ", y coord trafo/.code = {\\pgfluamathparse{\\pgfmathresult/" +
-            ToString(ySpacing) +"}}, y coord inv trafo/.code = {\\pgfluamathpa"
-            "res{\\pgfmathresult*" + ToString(ySpacing) + "}}";
+        src << ", y coord trafo/.code = {\\pgfluamathparse{\\pgfmathresult/"
+            << ySpacing << "}}, y coord inv trafo/.code = {\\pgfluamathpares{"
+            "\\pgfmathresult*" << ySpacing << "}}";
     }
     if(zSpacing)
     {
-        src += ", z coord trafo/.code = {\\pgfluamathparse{\\pgfmathresult/" +
-            ToString(zSpacing) +"}}, z coord inv trafo/.code = {\\pgfluamathpa"
-            "res{\\pgfmathresult*" + ToString(zSpacing) + "}}";
+        src << ", z coord trafo/.code = {\\pgfluamathparse{\\pgfmathresult/"
+            << zSpacing << "}}, z coord inv trafo/.code = {\\pgfluamathpares{"
+            "\\pgfmathresult*" << zSpacing << "}}";
     }
 
     if(_showColorbar)
     {
-        src += ", colorbar";
+        src << ", colorbar";
     }
 
     double xMinData = std::numeric_limits<double>::max();
@@ -887,12 +760,15 @@ std::string pgfplotter::Axis::plot_src(const std::string& path, int subplot) con
     {
         for(const auto& n : data)
         {
-            if(!n[0].empty())
+            for(const auto& m : n[0].segments())
             {
-                const auto xMinMax = std::minmax_element(n[0].begin(), n[0].
-                    end());
-                xMinData = std::min(xMinData, *(xMinMax.first));
-                xMaxData = std::max(xMaxData, *(xMinMax.second));
+                if(!m.empty())
+                {
+                    const auto xMinMax = std::minmax_element(m.begin(), m.
+                        end());
+                    xMinData = std::min(xMinData, *(xMinMax.first));
+                    xMaxData = std::max(xMaxData, *(xMinMax.second));
+                }
             }
         }
     }
@@ -903,34 +779,37 @@ std::string pgfplotter::Axis::plot_src(const std::string& path, int subplot) con
     {
         for(const auto& n : data)
         {
-            if(!n[1].empty())
+            for(const auto& m : n[1].segments())
             {
-                const auto yMinMax = std::minmax_element(n[1].begin(), n[1].
-                    end());
-                yMinData = std::min(yMinData, *(yMinMax.first));
-                yMaxData = std::max(yMaxData, *(yMinMax.second));
+                if(!m.empty())
+                {
+                    const auto yMinMax = std::minmax_element(m.begin(), m.
+                        end());
+                    yMinData = std::min(yMinData, *(yMinMax.first));
+                    yMaxData = std::max(yMaxData, *(yMinMax.second));
+                }
             }
         }
     }
 
     if(xMinSet || xSqueeze)
     {
-        src += ", xmin = " + ToString(xMinSet ? xMin : xMinData);
+        src << ", xmin = " << (xMinSet ? xMin : xMinData);
     }
     if(xMaxSet || xSqueeze)
     {
-        src += ", xmax = " + ToString(xMaxSet ? xMax : xMaxData);
+        src << ", xmax = " << (xMaxSet ? xMax : xMaxData);
     }
 
     const double tempYMin = yMinSet ? yMin : yMinData;
     const double tempYMax = yMaxSet ? yMax : yMaxData;
     if(yMinSet || ySqueeze)
     {
-        src += ", ymin = " + ToString(tempYMin);
+        src << ", ymin = " << tempYMin;
     }
     if(yMaxSet || ySqueeze)
     {
-        src += ", ymax = " + ToString(tempYMax);
+        src << ", ymax = " << tempYMax;
     }
 
     // Z/meta max/min don't seem to affect contour placement in contour plots.
@@ -938,217 +817,216 @@ std::string pgfplotter::Axis::plot_src(const std::string& path, int subplot) con
     {
         if(_viewAngles[0] != 0. || _viewAngles[1] != 90.)
         {
-            src += ", zmin = " + ToString(zMin);
+            src << ", zmin = " << zMin;
         }
-        src += ", point meta min = " + ToString(zMin);
+        src << ", point meta min = " << zMin;
     }
     if(zMaxSet)
     {
         if(_viewAngles[0] != 0. || _viewAngles[1] != 90.)
         {
-            src += ", zmax = " + ToString(zMax);
+            src << ", zmax = " << zMax;
         }
-        src += ", point meta max = " + ToString(zMax);
+        src << ", point meta max = " << zMax;
     }
 
     if(!_xLabel.empty())
     {
-        src += ", xlabel = {" + _xLabel + "}";
+        src << ", xlabel = {" << _xLabel << "}";
     }
     if(!_yLabel.empty())
     {
-        src += ", ylabel = {" + _yLabel + "}";
+        src << ", ylabel = {" << _yLabel << "}";
     }
     if(!_zLabel.empty())
     {
-        src += ", zlabel = {" + _zLabel + "}";
+        src << ", zlabel = {" << _zLabel << "}";
     }
     if(!_title.empty())
     {
-        src += ", title = {\\" + TitleSize + " " + _title + "}";
+        src << ", title = {\\" << TitleSize << " " << _title << "}";
     }
     if(legendPos)
     {
-        src += ", legend style = {font = \\" + LegendFontSize;
+        src << ", legend style = {font = \\" << LegendFontSize;
         if(legendPos == Northwest)
         {
-            src += ", at = {(0, 1)}, anchor = north west";
+            src << ", at = {(0, 1)}, anchor = north west";
         }
         else if(legendPos == Southwest)
         {
-            src += ", at = {(0, 0)}, anchor = south west";
+            src << ", at = {(0, 0)}, anchor = south west";
         }
         else if(legendPos == Southeast)
         {
-            src += ", at = {(1, 0)}, anchor = south east";
+            src << ", at = {(1, 0)}, anchor = south east";
         }
         else if(legendPos == Northeast)
         {
-            src += ", at = {(1, 1)}, anchor = north east";
+            src << ", at = {(1, 1)}, anchor = north east";
         }
         else
         {
             throw std::logic_error("Legend position " + std::to_string(
                 legendPos) + " not recognized.");
         }
-        src += ", legend style = {row sep = -2pt}}";
-        src += ", legend image post style = {fill opacity = 1, draw opacity = 1"
-            ", mark size = 2.}";
+        src << ", legend style = {row sep = -2pt}}, legend image post style = "
+            "{fill opacity = 1, draw opacity = 1, mark size = 2.}";
     }
     if(axisEqual)
     {
-        src += ", axis equal";
+        src << ", axis equal";
     }
     else if(axisEqualImage)
     {
-        src += ", axis equal image";
+        src << ", axis equal image";
     }
-    src += src1;
+    src << src1;
     if(!_viewAngles[0] && !_viewAngles[1])
     {
-        src += ", xlabel near ticks, ylabel near ticks";
+        src << ", xlabel near ticks, ylabel near ticks";
     }
-    src += ", x tick label style = {font = \\" + FontSize;
+    src << ", x tick label style = {font = \\" << FontSize;
     if(xPrecision >= 0)
     {
-        src += ", /pgf/number format/precision = " + ToString(xPrecision) +
-            ", /pgf/number format/zerofill";
+        src << ", /pgf/number format/precision = " << xPrecision << ", /pgf/nu"
+            "mber format/zerofill";
     }
     if(xFormat)
     {
-        src += ", scaled x ticks = false";
+        src << ", scaled x ticks = false";
     }
     if(xFormat == Fixed)
     {
-        src += ", /pgf/number format/fixed, /pgf/number format/fixed zerofill ="
+        src << ", /pgf/number format/fixed, /pgf/number format/fixed zerofill ="
             " true";
     }
     else if(xFormat == Sci)
     {
-        src += ", /pgf/number format/sci";
+        src << ", /pgf/number format/sci";
     }
     if(_rotateXTickLabels)
     {
-        src += ", rotate = 45, anchor = north east";
+        src << ", rotate = 45, anchor = north east";
     }
-    src += "}, y tick label style = {font = \\" + FontSize;
+    src << "}, y tick label style = {font = \\" << FontSize;
     if(yPrecision >= 0)
     {
-        src += ", /pgf/number format/precision = " + ToString(yPrecision) +
-            ", /pgf/number format/zerofill";
+        src << ", /pgf/number format/precision = " << yPrecision << ", /pgf/nu"
+            "mber format/zerofill";
     }
     if(yFormat)
     {
-        src += ", scaled y ticks = false";
+        src << ", scaled y ticks = false";
     }
     if(yFormat == Fixed)
     {
-        src += ", /pgf/number format/fixed, /pgf/number format/fixed zerofill ="
+        src << ", /pgf/number format/fixed, /pgf/number format/fixed zerofill ="
             " true";
     }
     else if(yFormat == Sci)
     {
-        src += ", /pgf/number format/sci";
+        src << ", /pgf/number format/sci";
     }
-    src += "}, z tick label style = {font = \\" + FontSize;
+    src << "}, z tick label style = {font = \\" << FontSize;
     if(zPrecision >= 0)
     {
-        src += ", /pgf/number format/precision = " + ToString(zPrecision) +
-            ", /pgf/number format/zerofill";
+        src << ", /pgf/number format/precision = " << zPrecision << ", /pgf/nu"
+            "mber format/zerofill";
     }
     if(zFormat)
     {
-        src += ", scaled z ticks = false";
+        src << ", scaled z ticks = false";
     }
     if(zFormat == Fixed)
     {
-        src += ", /pgf/number format/fixed, /pgf/number format/fixed zerofill ="
+        src << ", /pgf/number format/fixed, /pgf/number format/fixed zerofill ="
             " true";
     }
     else if(zFormat == Sci)
     {
-        src += ", /pgf/number format/sci";
+        src << ", /pgf/number format/sci";
     }
-    src += "}";
+    src << "}";
     if(!_xTicks.empty())
     {
-        src += ", xtick = {";
+        src << ", xtick = {";
         for(std::size_t i = 0; i < _xTicks.size(); ++i)
         {
-            src += ToString(_xTicks[i]);
+            src << _xTicks[i];
             if(i + 1 < _xTicks.size())
             {
-                src += ", ";
+                src << ", ";
             }
         }
-        src += "}";
+        src << "}";
     }
     if(!_xTickLabels.empty())
     {
-        src += ", xticklabels = {";
+        src << ", xticklabels = {";
         for(std::size_t i = 0; i < _xTickLabels.size(); ++i)
         {
-            src += _xTickLabels[i];
+            src << _xTickLabels[i];
             if(i + 1 < _xTickLabels.size())
             {
-                src += ", ";
+                src << ", ";
             }
         }
-        src += "}";
+        src << "}";
     }
     if(!_yTicks.empty())
     {
-        src += ", ytick = {";
+        src << ", ytick = {";
         for(std::size_t i = 0; i < _yTicks.size(); ++i)
         {
-            src += ToString(_yTicks[i]);
+            src << _yTicks[i];
             if(i + 1 < _yTicks.size())
             {
-                src += ", ";
+                src << ", ";
             }
         }
-        src += "}";
+        src << "}";
     }
     if(!_yTickLabels.empty())
     {
-        src += ", yticklabels = {";
+        src << ", yticklabels = {";
         for(std::size_t i = 0; i < _yTickLabels.size(); ++i)
         {
-            src += _yTickLabels[i];
+            src << _yTickLabels[i];
             if(i + 1 < _yTickLabels.size())
             {
-                src += ", ";
+                src << ", ";
             }
         }
-        src += "}";
+        src << "}";
     }
     if(!_zTicks.empty())
     {
-        src += ", ztick = {";
+        src << ", ztick = {";
         for(std::size_t i = 0; i < _zTicks.size(); ++i)
         {
-            src += ToString(_zTicks[i]);
+            src << _zTicks[i];
             if(i + 1 < _zTicks.size())
             {
-                src += ", ";
+                src << ", ";
             }
         }
-        src += "}";
+        src << "}";
     }
     if(!_zTickLabels.empty())
     {
-        src += ", zticklabels = {";
+        src << ", zticklabels = {";
         for(std::size_t i = 0; i < _zTickLabels.size(); ++i)
         {
-            src += _zTickLabels[i];
+            src << _zTickLabels[i];
             if(i + 1 < _zTickLabels.size())
             {
-                src += ", ";
+                src << ", ";
             }
         }
-        src += "}";
+        src << "}";
     }
-    src += src8;
+    src << src8;
 
     if(!_bgBands.empty() && (!yMinSet || !yMaxSet || _bgBands.size()%2))
     {
@@ -1156,9 +1034,9 @@ std::string pgfplotter::Axis::plot_src(const std::string& path, int subplot) con
     }
     for(std::size_t i = 0; i < _bgBands.size(); i += 2)
     {
-        src += "\\fill[black, opacity = 0.1] (" + ToString(_bgBands[i]) + ", " +
-            ToString(yMin) + ") rectangle (" + ToString(_bgBands[i + 1]) + ", "
-            + ToString(yMax) + ");" + endl;
+        src << "\\fill[black, opacity = 0.1] (" << _bgBands[i] << ", " << yMin
+            << ") rectangle (" << _bgBands[i + 1] << ", " << yMax << ");" <<
+            endl;
     }
 
     for(std::size_t i = 0, sz = surfaceX.size(); i < sz; ++i)
@@ -1183,46 +1061,76 @@ std::string pgfplotter::Axis::plot_src(const std::string& path, int subplot) con
             }
         }
 
-        if(numContours[i])
+        const GridSize& gridSize = gridSizes[i];
+        const std::size_t maxX = gridSize.automatic ? static_cast<std::size_t>(
+            std::ceil(relWidth*TextWidth*options.dpi/GridCellPixels)) :
+            gridSize.maxX;
+        const std::size_t maxY = gridSize.automatic ? static_cast<std::size_t>(
+            std::ceil(relHeight*TextWidth*options.dpi/GridCellPixels)) :
+            gridSize.maxY;
+        std::vector<const double*> columns = {surfaceX[i].data(), surfaceY[i].
+            data(), surfaceZ[i].data()};
+        std::size_t numKept = numPoints;
+        std::array<std::vector<double>, 3> pooled;
+        if(numPoints%numRows == 0 && ((maxX && numPoints/numRows > maxX) ||
+            (maxY && numRows > maxY)))
         {
-            src += "\\addplot3[contour gnuplot = {labels = false, number = " +
-                std::to_string(numContours[i]);
-            if(!dir.empty())
+            const std::array<std::size_t, 2> before = {numPoints/numRows,
+                numRows};
+            numRows = decimate_grid(columns[0], columns[1], columns[2],
+                numPoints/numRows, numRows, maxX, maxY, gridSize.pooling,
+                pooled);
+            numKept = pooled[0].size();
+            stats.droppedPoints += numPoints - numKept;
+            stats.pooledGrids.push_back({i, before, {numKept/numRows,
+                numRows}});
+            for(std::size_t j = 0; j < 3; ++j)
             {
-                src += ", cmd = {cd '" + dir + "' && gnuplot \\\"\\script\\\"}";
+                columns[j] = pooled[j].data();
             }
-            src += "}, mesh/rows = " + std::to_string(numRows) + ", mesh/num po"
-                "ints = " + std::to_string(numPoints) + "] table {";
         }
-        else if(matrixSurf[i])
+
+        const std::string dataFile = std::to_string(subplot) + "." + std::
+            to_string(i) + ".surf";
+        TableWriter out(path + Suffix + "/" + dataFile);
+        out.line("x y z");
+        if(numContours[i] && numKept%numRows)
         {
-            src += "\\addplot[matrix plot*, mesh/rows = " + std::to_string(
-                numRows) + ", mesh/ordering = y varies, point meta = explicit] "
-                "table[meta = z] {";
+            throw std::runtime_error("Contour data must be a grid.");
         }
-        else
+        if(numContours[i])
         {
-            src += "\\addplot3[unbounded coords = jump, surf, mesh/rows = " +
-                std::to_string(numRows) + ", mesh/ordering = y varies, shader ="
-                " interp, opacity = " + ToString(_opacity) + ", z buffer = sort"
-                "] table {";
+            src << "\\addplot3[contour prepared = {labels = false}] table {";
+            // Each line of the contour is ended by an empty line.
+            std::vector<double> level;
+            for(const auto& n : contour_lines(columns[0], columns[1], columns[
+                2], numKept/numRows, numRows, numContours[i]))
+            {
+                level.assign(n.x.size(), n.level);
+                out.rows({n.x.data(), n.y.data(), level.data()}, n.x.size());
+                out.line("");
+                stats.points += n.x.size();
+            }
         }
-        const std::string dataFile = std::to_string(subplot) + "." + std::
-            to_string(i) + ".surf";
-        src += dataFile + src3;
-        const std::string dataPath = path + Suffix + "/" + dataFile;
-        std::ofstream out(dataPath);
-        if(!out)
+        else if(matrixSurf[i])
         {
-            throw std::runtime_error("Failed to open temporary output file \"" +
-                dataPath + "\".");
+            src << "\\addplot[matrix plot*, mesh/rows = " << numRows << ", mes"
+                "h/ordering = y varies, point meta = explicit] table[meta = z] "
+                "{";
+            out.rows(columns, numKept);
+            stats.points += numKept;
         }
-        out << "x y z" << std::endl;
-        for(std::size_t j = 0; j < numPoints; ++j)
+        else
         {
-            out << ToString(surfaceX[i][j]) << " " << ToString(surfaceY[i][j])
-                << " " << ToString(surfaceZ[i][j]) << std::endl;
+            src << "\\addplot3[unbounded coords = jump, surf, mesh/rows = " <<
+                numRows << ", mesh/ordering = y varies, shader = interp, opacit"
+                "y = " << _opacity << ", z buffer = sort] table {";
+            out.rows(columns, numKept);
+            stats.points += numKept;
         }
+        src << dataFile << src3;
+        stats.bytes += out.close();
+        stats.files.push_back(dataFile);
     }
 
     for(std::size_t i = 0; i < fillX.size(); ++i)
@@ -1232,24 +1140,48 @@ std::string pgfplotter::Axis::plot_src(const std::string& path, int subplot) con
         {
             throw std::runtime_error("Number of points in x and y must match.");
         }
-        src += "\\fill[";
+        src << "\\fill[";
         if(fillColors[i][0] >= 0)
         {
-            src += "rgb color = {" + std::to_string(fillColors[i][0]) + ", " +
-                std::to_string(fillColors[i][1]) + ", " + std::to_string(
-                fillColors[i][2]) + "}";
+            src << "rgb color = {" << fillColors[i][0] << ", " << fillColors[
+                i][1] << ", " << fillColors[i][2] << "}";
         }
         else
         {
-            src += "black";
+            src << "black";
         }
-        src += "] ";
+        src << "] ";
         for(std::size_t j = 0; j < numPoints; ++j)
         {
-            src += "(" + ToString(fillX[i][j]) + ", " + ToString(fillY[i][j]) +
-                ")--";
+            src << "(" << fillX[i][j] << ", " << fillY[i][j] << ")--";
         }
-        src += "cycle;" + endl;
+        src << "cycle;" << endl;
+    }
+
+    // Pixel columns across the axis and the x range they cover, for
+    // decimation.
+    const std::size_t numPixels = static_cast<std::size_t>(std::ceil(relWidth*
+        TextWidth*options.dpi));
+    double xLo = std::numeric_limits<double>::infinity();
+    double xHi = -std::numeric_limits<double>::infinity();
+    if(_decimate)
+    {
+        for(const auto& n : data)
+        {
+            for(const auto& m : n[0].segments())
+            {
+                for(const double x : m)
+                {
+                    if(std::isfinite(x) && (!xLog || x > 0.))
+                    {
+                        xLo = std::min(xLo, x);
+                        xHi = std::max(xHi, x);
+                    }
+                }
+            }
+        }
+        xLo = xMinSet ? xMin : xLo;
+        xHi = xMaxSet ? xMax : xHi;
     }
 
     for(std::size_t i = 0, sz = data.size(); i < sz; ++i)
@@ -1272,108 +1204,197 @@ std::string pgfplotter::Axis::plot_src(const std::string& path, int subplot) con
 
         const bool hasLines = lineStyles[i] != LineStyle::None;
 
-        src += is3D ? "\\addplot3+[" : "\\addplot+[";
+        // Options of `\addplot`, written straight into the source.
+        const std::string dataFile = std::to_string(subplot) + "." + std::
+            to_string(i) + ".data";
+        src << (is3D ? "\\addplot3+[" : "\\addplot+[");
         if(lineStyles[i] == LineStyle::Dashed)
         {
-            src += "densely dashed, ";
+            src << "densely dashed, ";
         }
         else if(lineStyles[i] == LineStyle::Dotted)
         {
-            src += "densely dotted, ";
+            src << "densely dotted, ";
         }
         else if(lineStyles[i] == LineStyle::None)
         {
-            src += "only marks, ";
+            src << "only marks, ";
         }
         if(markers[i].mark > 0)
         {
-            src += "mark = " + convert_marker(markers[i].mark) + ", mark size ="
-                " " + ToString(3.*markers[i].size);
+            src << "mark = " << convert_marker(markers[i].mark) << ", mark s"
+                "ize = " << 3.*markers[i].size;
             if(markers[i].spacing)
             {
-                src += ", mark repeat = " + std::to_string(markers[i].spacing);
+                src << ", mark repeat = " << markers[i].spacing;
             }
         }
         else if(markers[i].mark < 0 && MarkCycle(i).mark > 0)
         {
-            src += "mark = " + convert_marker(MarkCycle(i).mark) + ", mark size"
-                " = " + ToString(3.*MarkCycle(i).size*markers[i].size);
+            src << "mark = " << convert_marker(MarkCycle(i).mark) << ", mark"
+                " size = " << 3.*MarkCycle(i).size*markers[i].size;
             if(markers[i].spacing)
             {
-                src += ", mark repeat = " + std::to_string(markers[i].spacing);
+                src << ", mark repeat = " << markers[i].spacing;
             }
         }
         else
         {
-            src += "mark = none";
+            src << "mark = none";
         }
         if(colors[i][0] >= 0)
         {
-            src += ", rgb color = {" + std::to_string(colors[i][0]) + ", " +
-                std::to_string(colors[i][1]) + ", " + std::to_string(colors[i][
-                2]) + "}";
+            src << ", rgb color = {" << colors[i][0] << ", " << colors[i][1] <<
+                ", " << colors[i][2] << "}";
         }
         else if(colors[i][0] == Color::FromW[0])
         {
             if(hasLines)
             {
-                src += ", mesh, point meta = explicit, shader = interp";
+                src << ", mesh, point meta = explicit, shader = interp";
             }
             if(markers[i].mark)
             {
-                src += ", scatter, scatter src = explicit, scatter/use mapped c"
-                    "olor = {draw = mapped color, fill = mapped color}";
+                src << ", scatter, scatter src = explicit, scatter/use mapped"
+                    " color = {draw = mapped color, fill = mapped color}";
             }
         }
-        src += ", fill opacity = " + std::to_string(opacities[i]) +
-            ", draw opacity = " + std::to_string(opacities[i]);
+        // As `std::to_string` formats them.
+        src << ", fill opacity = " << FixedPoint{opacities[i]} << ", draw op"
+            "acity = " << FixedPoint{opacities[i]};
         if(lineWidths[i] != 1.)
         {
-            src += ", line width = " + std::to_string(1.6*lineWidths[i]) + "pt";
+            src << ", line width = " << FixedPoint{1.6*lineWidths[i]} << "pt";
         }
-        const std::string dataFile = std::to_string(subplot) + "." + std::
-            to_string(i) + ".data";
-        src += "] table" + std::string(hasMeta ? "[meta = w]" : "") + " {" +
-            dataFile + src3;
-        const std::string dataPath = path + Suffix + "/" + dataFile;
-        std::ofstream out(dataPath);
-        if(!out)
+        src << "] table" << (hasMeta ? "[meta = w]" : "") << " {" << dataFile <<
+            src3;
+        // The columns in contiguous blocks, several if appended through a
+        // `Series`, written without being gathered first.
+        const std::size_t numColumns = 2 + is3D + hasMeta;
+        std::vector<TableBlock> blocks;
         {
-            throw std::runtime_error("Failed to open temporary output file \"" +
-                dataPath + "\".");
+            std::vector<std::vector<ArrayView>> segments = {data[i][0].
+                segments(), data[i][1].segments()};
+            if(is3D)
+            {
+                segments.push_back(data[i][2].segments());
+            }
+            if(hasMeta)
+            {
+                segments.push_back(data[i][3].segments());
+            }
+            for(std::size_t j = 0; j < segments[0].size(); ++j)
+            {
+                blocks.push_back({{}, segments[0][j].size()});
+                for(const auto& n : segments)
+                {
+                    blocks.back().columns.push_back(n[j].data());
+                }
+            }
         }
-        out << "x y" << (is3D ? " z" : "") << (hasMeta ? " w" : "") << std::
-            endl;
-        for(std::size_t j = 0; j < numPoints; ++j)
+
+        // Markers would show which points were dropped.
+        const bool hasMarks = markers[i].mark > 0 || (markers[i].mark < 0 &&
+            MarkCycle(i).mark > 0);
+        std::vector<std::vector<double>> kept;
+        if(_decimate && hasLines && !hasMarks && !is3D && xLo < xHi &&
+            numPoints > 4*numPixels)
         {
-            out << ToString(data[i][0][j]) << " " << ToString(data[i][1][j]) <<
-                (is3D ? " " + ToString(data[i][2][j]) : "") << (hasMeta ? " " +
-                ToString(data[i][3][j]) : "") << std::endl;
+            std::vector<std::vector<std::size_t>> keep(blocks.size());
+            parallel_for(blocks.size(), [&](std::size_t j)
+            {
+                keep[j] = decimate_line(blocks[j].columns[0], blocks[j].
+                    columns[1], blocks[j].numRows, xLo, xHi, numPixels, xLog);
+            });
+            kept.resize(numColumns);
+            for(std::size_t j = 0; j < blocks.size(); ++j)
+            {
+                for(std::size_t k = 0; k < numColumns; ++k)
+                {
+                    for(const auto& n : keep[j])
+                    {
+                        kept[k].push_back(blocks[j].columns[k][n]);
+                    }
+                }
+            }
+            stats.droppedPoints += numPoints - kept[0].size();
+            blocks = {{{}, kept[0].size()}};
+            for(const auto& n : kept)
+            {
+                blocks[0].columns.push_back(n.data());
+            }
         }
+
+        for(const auto& n : blocks)
+        {
+            stats.points += n.numRows;
+        }
+        TableWriter out(path + Suffix + "/" + dataFile);
+        out.line(std::string("x y") + (is3D ? " z" : "") + (hasMeta ? " w" :
+            ""));
+        out.rows(blocks);
+        stats.bytes += out.close();
+        stats.files.push_back(dataFile);
     }
 
     if(legendPos)
     {
-        src += "\\legend{";
+        src << "\\legend{";
         for(const auto& n : names)
         {
-            src += "{" + n + "}, ";
+            src << "{" << n << "}, ";
         }
-        src += "}" + endl;
+        src << "}" << endl;
     }
-
-    return src;
 }
 
 void pgfplotter::plot(const std::string& path, const std::vector<const
     pgfplotter::Axis*>& p)
 {
-    if(p.empty())
+    plot(path, p, PlotOptions());
+}
+
+void pgfplotter::Axis::own_values()
+{
+    auto own = [](Column& c)
     {
-        std::cerr << "Warning: No plots provided for \"" << path << ".png\"."
-            << std::endl;
-        return;
+        if(c.borrowed())
+        {
+            c = std::vector<double>(c.begin(), c.end());
+        }
+        c.snapshot();
+    };
+    for(auto& n : data)
+    {
+        for(auto& m : n)
+        {
+            own(m);
+        }
+    }
+    for(auto* n : {&surfaceX, &surfaceY, &surfaceZ})
+    {
+        for(auto& m : *n)
+        {
+            own(m);
+        }
     }
+}
+
+std::string pgfplotter::Axis::document_src(const std::string& path, const std::
+    vector<const Axis*>& p, const PlotOptions& options, PlotStats& stats)
+{
+    const auto start = std::chrono::steady_clock::now();
+    stats = PlotStats();
+    if(path.empty())
+    {
+        throw std::runtime_error("Plot name is empty.");
+    }
+    if(!options.dpi)
+    {
+        throw std::runtime_error("Resolution must be positive.");
+    }
+    const std::string dataPath = scratch_path(path, options);
+    create_data_dir(dataPath);
 
     bool b = false;
     for(const auto& n : p)
@@ -1381,13 +1402,76 @@ void pgfplotter::plot(const std::string& path, const std::vector<const
         b = b || n->_noSep;
     }
 
-    std::string src = src0 + src9 + src2a + std::to_string(p.size()) + (b ?
-        src2bNoSep : src2b);
-    for(std::size_t i = 0, n = p.size(); i < n; ++i)
+    // Subplots are generated concurrently, each writing only its own data
+    // files, and joined in order so the source does not depend on timing.
+    std::vector<std::string> subplots(p.size());
+    stats.subplots.resize(p.size());
     {
-        src += p[i]->plot_src(path, i);
+        ThreadBudget budget(options.threads ? options.threads : threadBudget);
+        parallel_for(p.size(), [&](std::size_t i)
+        {
+            const auto subplotStart = std::chrono::steady_clock::now();
+            p[i]->plot_src(subplots[i], dataPath, i, options, stats.subplots[
+                i]);
+            stats.subplots[i].seconds = std::chrono::duration<double>(std::
+                chrono::steady_clock::now() - subplotStart).count();
+        });
     }
-    src += src4 + src5;
+    for(const auto& n : stats.subplots)
+    {
+        stats.droppedPoints += n.droppedPoints;
+    }
+
+    // The fixed parts are joined once, and the document is written into a
+    // buffer of its final size.
+    static const std::string head = preamble_src() + src2a;
+    static const std::string tail = src4 + src5;
+    std::size_t size = head.size() + std::max(src2b.size(), src2bNoSep.
+        size()) + tail.size() + 20;
+    for(const auto& n : subplots)
+    {
+        size += n.size();
+    }
+    std::string src;
+    src.reserve(size);
+    SourceWriter out(src);
+    out << head << p.size() << (b ? src2bNoSep : src2b);
+    for(const auto& n : subplots)
+    {
+        out << n;
+    }
+    out << tail;
+    stats.stages.push_back({"source", std::chrono::duration<double>(std::
+        chrono::steady_clock::now() - start).count()});
+    return src;
+}
 
-    compile(path, src, false);
+void pgfplotter::plot(const std::string& path, const std::vector<const
+    pgfplotter::Axis*>& p, const PlotOptions& options)
+{
+    if(p.empty())
+    {
+        std::cerr << "Warning: No plots provided for \"" << output_name(path,
+            options) << "\"." << std::endl;
+        return;
+    }
+
+    if(options.preview)
+    {
+        const std::string warnings = render_preview(path, p, options);
+        std::cout << "Plotted \"" << path << ".png\"" << std::endl;
+        print_warnings(warnings);
+        return;
+    }
+
+    PlotStats stats;
+    const std::string src = Axis::document_src(path, p, options, stats);
+    try
+    {
+        compile(path, src, options, std::move(stats), false);
+    }
+    catch(const PlotError& e)
+    {
+        std::cerr << "Warning: " << e.what() << std::endl;
+    }
 }
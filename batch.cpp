@@ -0,0 +1,227 @@
+#include "pgfplotter"
+#include "compile.hpp"
+#include "parallel.hpp"
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+class pgfplotter::BatchScheduler
+{
+    struct Job
+    {
+        // 0 generates the source, the next steps run the toolchain stages in
+        // order and the last one moves the PNG into place.
+        std::size_t step = 0;
+        bool busy = false;
+        bool done = false;
+        std::unique_ptr<Build> build;
+    };
+
+    // Generates the source of job `i` and sets up its build, or returns null
+    // if it rendered a preview instead, setting the second argument to its
+    // warnings.
+    const std::function<std::unique_ptr<Build>(std::size_t, std::string&)>
+        start;
+    // Whether to delete rather than archive the data of finished jobs.
+    const bool deleteData;
+    std::vector<Job> state;
+    std::vector<BatchResult> results;
+    // Jobs from here on haven't been started, so the source of a job is only
+    // generated once a worker is free to run it.
+    std::size_t started = 0;
+    std::size_t remaining;
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    // The idle job furthest along, or `state.size()` if every job is busy or
+    // done.
+    std::size_t pick() const
+    {
+        std::size_t best = state.size();
+        for(std::size_t i = 0; i < started; ++i)
+        {
+            if(!state[i].busy && !state[i].done && (best == state.size() ||
+                state[i].step > state[best].step))
+            {
+                best = i;
+            }
+        }
+        return best == state.size() ? started : best;
+    }
+
+    // Runs the next step of job `i`. Returns true once the job is finished.
+    bool advance(std::size_t i)
+    {
+        Job& s = state[i];
+        try
+        {
+            if(!s.step)
+            {
+                std::string warnings;
+                s.build = start(i, warnings);
+                if(!s.build)
+                {
+                    results[i] = {true, warnings, nullptr};
+                    return true;
+                }
+                if(s.build->restore())
+                {
+                    s.step = s.build->stages().size();
+                }
+            }
+            else if(s.step <= s.build->stages().size())
+            {
+                s.build->run(s.build->stages()[s.step - 1]);
+            }
+            else
+            {
+                results[i] = {true, s.build->finish(deleteData), nullptr};
+                return true;
+            }
+        }
+        catch(const std::exception& e)
+        {
+            results[i] = {false, e.what(), std::current_exception()};
+            return true;
+        }
+        ++s.step;
+        return false;
+    }
+
+    void work()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(remaining)
+        {
+            const std::size_t i = pick();
+            if(i == state.size())
+            {
+                changed.wait(lock);
+                continue;
+            }
+            if(i == started)
+            {
+                ++started;
+            }
+            state[i].busy = true;
+            lock.unlock();
+            const bool finished = advance(i);
+            lock.lock();
+            state[i].busy = false;
+            if(finished)
+            {
+                state[i].done = true;
+                state[i].build.reset();
+                --remaining;
+            }
+            changed.notify_all();
+        }
+    }
+
+    BatchScheduler(std::size_t numJobs, std::function<std::unique_ptr<Build>(
+        std::size_t, std::string&)> start, bool deleteData) : start(std::move(
+        start)), deleteData(deleteData), state(numJobs), results(numJobs),
+        remaining(numJobs) {}
+
+    std::vector<BatchResult> run(unsigned int maxProcesses)
+    {
+        ThreadBudget budget(maxProcesses);
+        const std::size_t numWorkers = std::min<std::size_t>(thread_budget(),
+            state.size());
+        parallel_for(numWorkers, [&](std::size_t)
+        {
+            work();
+        });
+        return std::move(results);
+    }
+
+public:
+    static std::vector<BatchResult> batch(const std::vector<BatchJob>& jobs,
+        unsigned int maxProcesses)
+    {
+        return BatchScheduler(jobs.size(), [&](std::size_t i, std::string&
+            warnings)
+        {
+            const BatchJob& job = jobs[i];
+            if(job.axes.empty())
+            {
+                throw PlotError("No plots provided for \"" + output_name(job.
+                    path, job.options) + "\".");
+            }
+            if(job.options.preview)
+            {
+                warnings = render_preview(job.path, job.axes, job.options);
+                return std::unique_ptr<Build>();
+            }
+            PlotStats stats;
+            const std::string src = Axis::document_src(job.path, job.axes,
+                job.options, stats);
+            return std::make_unique<Build>(job.path, src, job.options, std::
+                move(stats));
+        }, false).run(maxProcesses);
+    }
+
+    static std::vector<BatchResult> animate(const std::string& path, const
+        Axis& layout, std::size_t numFrames, const std::function<void(std::
+        size_t, Axis&)>& frame, const PlotOptions& options, unsigned int
+        maxProcesses)
+    {
+        const std::size_t width = std::to_string(numFrames ? numFrames - 1 :
+            0).size();
+        // The stages and Makefile of every frame, made by the first frame to
+        // need them and named after the animation rather than the frame.
+        std::once_flag once;
+        std::shared_ptr<const Recipe> recipe;
+        return BatchScheduler(numFrames, [&](std::size_t i, std::string&
+            warnings)
+        {
+            std::ostringstream name;
+            name << path << '-' << std::setw(width) << std::setfill('0') << i;
+            Axis axis = layout;
+            frame(i, axis);
+            if(options.preview)
+            {
+                warnings = render_preview(name.str(), {&axis}, options);
+                return std::unique_ptr<Build>();
+            }
+            std::call_once(once, [&]()
+            {
+                std::string dir, job;
+                split_path(path, dir, job);
+                recipe = std::make_shared<const Recipe>(job, options);
+            });
+            PlotStats stats;
+            const std::string src = Axis::document_src(name.str(), {&axis},
+                options, stats);
+            return std::make_unique<Build>(name.str(), src, options, std::move(
+                stats), recipe);
+        }, true).run(maxProcesses);
+    }
+};
+
+std::vector<pgfplotter::BatchResult> pgfplotter::plot_batch(const std::vector<
+    BatchJob>& jobs, unsigned int maxProcesses)
+{
+    return BatchScheduler::batch(jobs, maxProcesses);
+}
+
+pgfplotter::AnimationResult pgfplotter::animate(const std::string& path, const
+    Axis& layout, std::size_t numFrames, const std::function<void(std::size_t,
+    Axis&)>& frame, const PlotOptions& options, unsigned int maxProcesses)
+{
+    const auto start = std::chrono::steady_clock::now();
+    AnimationResult result;
+    result.frames = BatchScheduler::animate(path, layout, numFrames, frame,
+        options, maxProcesses);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::
+        now() - start).count();
+    for(const auto& n : result.frames)
+    {
+        result.numRendered += n.success;
+    }
+    result.framesPerSecond = result.seconds > 0. ? result.numRendered/result.
+        seconds : 0.;
+    return result;
+}
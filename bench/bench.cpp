@@ -0,0 +1,650 @@
+#include "pgfplotter"
+#include "compile.hpp"
+#include "table_writer.hpp"
+#include "decimate.hpp"
+#include "detect_os.hpp"
+#include <filesystem>
+#include <fstream>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#ifdef OS_UNIX
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace pgf = pgfplotter;
+
+// Heap allocations made by the whole process, for `bench_emit`.
+static std::atomic<std::size_t> numAllocations(0);
+
+void* operator new(std::size_t size)
+{
+    numAllocations.fetch_add(1, std::memory_order_relaxed);
+    if(void* p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+static std::string get_dir(const std::string& path)
+{
+    if(path.empty())
+    {
+        return {};
+    }
+    const std::filesystem::path p(path);
+    return p.parent_path().string();
+}
+
+// Runs `f` once and returns the elapsed wall time in seconds.
+template<typename F>
+static double time_it(F&& f)
+{
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+        start).count();
+}
+
+static void report(const std::string& name, double seconds, std::size_t items,
+    std::uintmax_t bytes)
+{
+    std::printf("%-40s %9.3f s %12.0f items/s %9.1f MB/s\n", name.c_str(),
+        seconds, items/seconds, bytes/seconds/1e6);
+}
+
+// `Axis::ToString` as it was before `format_double`.
+static std::string to_string_stream(double x)
+{
+    std::stringstream ss;
+    ss << std::setprecision(10) << x;
+    return ss.str();
+}
+
+// Formats `n` values spanning 21 orders of magnitude with `Axis::ToString`
+// and the stringstream it replaced.
+static void bench_to_string(std::size_t n)
+{
+    std::vector<double> x(n);
+    for(std::size_t i = 0; i < n; ++i)
+    {
+        x[i] = std::sin(i*0.618034)*std::pow(10., static_cast<int>(i%21) - 10);
+    }
+    std::size_t size = 0;
+    const double tOld = time_it([&]()
+    {
+        for(const auto& v : x)
+        {
+            size += to_string_stream(v).size();
+        }
+    });
+    report("ToString, stringstream", tOld, n, size);
+    size = 0;
+    const double tNew = time_it([&]()
+    {
+        for(const auto& v : x)
+        {
+            size += pgf::Axis::ToString(v).size();
+        }
+    });
+    report("ToString, Axis::ToString", tNew, n, size);
+}
+
+static void bench_table(const std::string& dir, std::size_t numRows)
+{
+    std::vector<double> x(numRows);
+    std::vector<double> y(numRows);
+    for(std::size_t i = 0; i < numRows; ++i)
+    {
+        x[i] = i*1e-3;
+        y[i] = std::sin(x[i])*std::exp(-x[i]*1e-3);
+    }
+
+    const std::string oldPath = dir + "/old.data";
+    const double tOld = time_it([&]()
+    {
+        // What `Axis::plot_src` did before `TableWriter`.
+        std::ofstream out(oldPath);
+        out << "x y" << std::endl;
+        for(std::size_t i = 0; i < numRows; ++i)
+        {
+            out << to_string_stream(x[i]) << " " << to_string_stream(y[i]) <<
+                std::endl;
+        }
+    });
+    report("table, stringstream + endl", tOld, numRows, std::filesystem::
+        file_size(oldPath));
+
+    const std::string newPath = dir + "/new.data";
+    const double tNew = time_it([&]()
+    {
+        pgf::TableWriter out(newPath);
+        out.line("x y");
+        out.rows({x.data(), y.data()}, numRows);
+        out.close();
+    });
+    report("table, TableWriter", tNew, numRows, std::filesystem::file_size(
+        newPath));
+}
+
+// Decimates a random walk of `numPoints` points to a full-width axis at 300
+// DPI.
+static void bench_decimate(std::size_t numPoints)
+{
+    std::vector<double> x(numPoints);
+    std::vector<double> y(numPoints);
+    double walk = 0.;
+    for(std::size_t i = 0; i < numPoints; ++i)
+    {
+        x[i] = i;
+        walk += std::sin(i*0.618034)*std::cos(i*0.001);
+        y[i] = walk;
+    }
+    std::size_t numKept = 0;
+    const double t = time_it([&]()
+    {
+        numKept = pgf::decimate_line(x.data(), y.data(), numPoints, x.front(),
+            x.back(), static_cast<std::size_t>(std::ceil(pgf::TextWidth*300.)),
+            false).size();
+    });
+    report("decimate, " + std::to_string(numKept) + " kept", t, numPoints,
+        numPoints*2*sizeof(double));
+}
+
+// Peak resident set size of this process in MB, or -1 if unknown.
+static double peak_rss()
+{
+#ifdef OS_UNIX
+    rusage usage;
+    if(!getrusage(RUSAGE_SELF, &usage))
+    {
+#ifdef OS_MACOS
+        return usage.ru_maxrss/1e6;
+#else
+        return usage.ru_maxrss/1e3;
+#endif
+    }
+#endif
+    return -1.;
+}
+
+// Hands `numPoints` points to `Axis::draw` by copy, move or view. Run in a
+// separate process per mode so each reports its own peak RSS.
+static void bench_ingest(const std::string& mode, std::size_t numPoints)
+{
+    std::vector<double> x(numPoints);
+    std::vector<double> y(numPoints);
+    for(std::size_t i = 0; i < numPoints; ++i)
+    {
+        x[i] = i;
+        y[i] = std::sqrt(x[i]);
+    }
+
+    pgf::Axis p;
+    const double t = time_it([&]()
+    {
+        if(mode == "copy")
+        {
+            p.draw(pgf::BasicLine, x, y);
+        }
+        else if(mode == "move")
+        {
+            p.draw(pgf::BasicLine, std::move(x), std::move(y));
+        }
+        else if(mode == "view")
+        {
+            p.draw(pgf::BasicLine, {x.data(), x.size()}, {y.data(), y.size()});
+        }
+        else
+        {
+            throw std::runtime_error("Unknown ingestion mode \"" + mode +
+                "\".");
+        }
+    });
+    std::printf("%-40s %9.3f s %12.0f items/s %9.0f MB peak\n", ("ingest, " +
+        mode).c_str(), t, numPoints/t, peak_rss());
+}
+
+// Generates the source and data files of eight series of 10^5 points and a
+// 256 by 256 surface, without running the toolchain.
+static void bench_source(const std::string& dir)
+{
+    pgf::Axis p;
+    for(std::size_t j = 0; j < 8; ++j)
+    {
+        std::vector<double> x(100000);
+        std::vector<double> y(x.size());
+        for(std::size_t i = 0; i < x.size(); ++i)
+        {
+            x[i] = i*1e-3;
+            y[i] = std::sin(x[i] + j);
+        }
+        p.draw(pgf::BasicLine, std::move(x), std::move(y));
+    }
+    pgf::Axis q;
+    const auto grid = pgf::mesh_grid([](double x, double y)
+        {
+            return std::sin(3.*x)*std::cos(2.*y);
+        }, 0., 2., 0., 2., 256);
+    q.surf(grid[0], grid[1], grid[2]);
+
+    pgf::PlotStats stats;
+    pgf::PlotOptions options;
+    options.format = pgf::OutputFormat::TeX;
+    options.archive = false;
+    options.stats = &stats;
+    pgf::plot(dir + "/source", {&p, &q}, options);
+    std::size_t numPoints = 0;
+    std::uintmax_t bytes = 0;
+    for(const auto& n : stats.subplots)
+    {
+        numPoints += n.points;
+        bytes += n.bytes;
+    }
+    report("source", stats.stages.front().seconds, numPoints, bytes);
+}
+
+// Generates the TeX source of a figure whose size is mostly in the source
+// itself (fill vertices, ticks and the styles of many short series) rather
+// than in data files, `NumRuns` times. Reports the median throughput of the
+// source stage in emitted bytes and the heap allocations per run.
+static void bench_emit(const std::string& dir)
+{
+    constexpr std::size_t NumRuns = 11;
+    pgf::Axis p;
+    std::size_t numVertices = 0;
+    for(int i = 0; i < 200; ++i)
+    {
+        std::vector<double> x(100);
+        std::vector<double> y(x.size());
+        for(std::size_t j = 0; j < x.size(); ++j)
+        {
+            x[j] = i + std::cos(j*0.0628)/3.;
+            y[j] = std::sin(j*0.0628 + i)/3.;
+        }
+        numVertices += x.size();
+        p.fill({i, 255 - i, 128}, x, y);
+    }
+    for(int i = 0; i < 50; ++i)
+    {
+        p.draw(pgf::BasicLine, std::vector<double>{0., 1.}, std::vector<double>{
+            i*0.01, i*0.02}, {}, {}, "series " + std::to_string(i));
+    }
+    std::vector<double> ticks(100);
+    for(std::size_t i = 0; i < ticks.size(); ++i)
+    {
+        ticks[i] = i*2.0202;
+    }
+    p.setXTicks(ticks);
+    p.setYTicks(ticks);
+    p.legend();
+    pgf::Axis q = p;
+
+    pgf::PlotOptions options;
+    options.format = pgf::OutputFormat::TeX;
+    options.archive = false;
+    std::vector<double> seconds;
+    std::vector<std::size_t> allocations;
+    for(std::size_t i = 0; i < NumRuns; ++i)
+    {
+        pgf::PlotStats stats;
+        options.stats = &stats;
+        const std::size_t before = numAllocations.load();
+        pgf::plot(dir + "/emit", {&p, &q}, options);
+        allocations.push_back(numAllocations.load() - before);
+        seconds.push_back(stats.stages.front().seconds);
+    }
+    std::sort(seconds.begin(), seconds.end());
+    std::sort(allocations.begin(), allocations.end());
+    const std::uintmax_t bytes = std::filesystem::file_size(dir +
+        "/emit_plot_data/emit.tex");
+    report("emit", seconds[NumRuns/2], 2*numVertices, bytes);
+    std::printf("%-40s %9zu allocations %9zu bytes of source\n", "",
+        allocations[NumRuns/2], static_cast<std::size_t>(bytes));
+}
+
+// Plots a small figure end to end `NumRuns` times, reporting the median and
+// fastest run and the median of each stage. With the stub toolchain, this is
+// the overhead of the pipeline itself.
+static void bench_plot(const std::string& dir)
+{
+    constexpr std::size_t NumRuns = 11;
+    pgf::Axis p;
+    std::vector<double> x(1000);
+    std::vector<double> y(x.size());
+    for(std::size_t i = 0; i < x.size(); ++i)
+    {
+        x[i] = i*1e-2;
+        y[i] = std::cos(x[i]);
+    }
+    p.draw(pgf::BasicLine, std::move(x), std::move(y));
+
+    std::vector<double> totals;
+    std::vector<pgf::PlotStats> runs(NumRuns);
+    for(auto& n : runs)
+    {
+        pgf::PlotOptions options;
+        options.stats = &n;
+        try
+        {
+            totals.push_back(time_it([&]()
+            {
+                pgf::plot(dir + "/plot", {&p}, options);
+            }));
+        }
+        catch(const std::exception& e)
+        {
+            std::printf("%-40s failed: %s\n", "plot", e.what());
+            return;
+        }
+    }
+    auto median = [](std::vector<double> v)
+    {
+        std::nth_element(v.begin(), v.begin() + v.size()/2, v.end());
+        return v[v.size()/2];
+    };
+    std::printf("%-40s %9.3f s median %9.3f s fastest\n", "plot, end to end",
+        median(totals), *std::min_element(totals.begin(), totals.end()));
+    for(std::size_t i = 0; i < runs[0].stages.size(); ++i)
+    {
+        std::vector<double> seconds;
+        for(const auto& n : runs)
+        {
+            seconds.push_back(n.stages[i].seconds);
+        }
+        std::printf("    %-36s %9.3f s median\n", runs[0].stages[i].name.
+            c_str(), median(seconds));
+    }
+}
+
+// Plots the same figure with each conversion pipeline and reports the time
+// taken by each toolchain stage. Needs the external toolchain.
+static void bench_pipeline(const std::string& dir)
+{
+    pgf::Axis p;
+    std::vector<double> x(1000);
+    std::vector<double> y(x.size());
+    for(std::size_t i = 0; i < x.size(); ++i)
+    {
+        x[i] = i*1e-2;
+        y[i] = std::sin(x[i]);
+    }
+    p.draw(pgf::BasicLine, std::move(x), std::move(y));
+
+    const std::pair<std::string, pgf::Pipeline> pipelines[] = {
+        {"postscript", pgf::Pipeline::PostScript},
+        {"prepress", pgf::Pipeline::Prepress},
+        {"direct", pgf::Pipeline::Direct}
+    };
+    for(const auto& n : pipelines)
+    {
+        pgf::PlotStats stats;
+        pgf::PlotOptions options;
+        options.pipeline = n.second;
+        options.stats = &stats;
+        double total = 0.;
+        try
+        {
+            total = time_it([&]()
+            {
+                pgf::plot(dir + "/pipeline-" + n.first, {&p}, options);
+            });
+        }
+        catch(const std::exception& e)
+        {
+            std::printf("%-40s failed: %s\n", ("pipeline, " + n.first).c_str(),
+                e.what());
+            continue;
+        }
+        std::printf("%-40s %9.3f s\n", ("pipeline, " + n.first).c_str(),
+            total);
+        for(const auto& m : stats.stages)
+        {
+            std::printf("    %-36s %9.3f s", m.name.c_str(), m.seconds);
+            if(m.peakMemory)
+            {
+                std::printf(" %9.1f MiB", m.peakMemory/1048576.);
+            }
+            std::printf("\n");
+        }
+    }
+}
+
+// Renders a line of 10^6 points, a 512 by 512 heatmap with contours and a
+// scatter plot through the built-in preview, without the toolchain.
+static void bench_preview(const std::string& dir)
+{
+    pgf::Axis line;
+    std::vector<double> x(1000000);
+    std::vector<double> y(x.size());
+    for(std::size_t i = 0; i < x.size(); ++i)
+    {
+        x[i] = i*1e-5;
+        y[i] = std::sin(x[i]) + 0.1*std::sin(i*0.37);
+    }
+    line.draw(pgf::BasicLine, std::move(x), std::move(y));
+
+    pgf::Axis heatmap;
+    const auto grid = pgf::mesh_grid([](double x, double y)
+        {
+            return std::sin(3.*x)*std::cos(2.*y);
+        }, 0., 2., 0., 2., 512);
+    heatmap.matrix(grid[0], grid[1], grid[2]);
+    heatmap.contour(grid[0], grid[1], grid[2], 10);
+
+    pgf::Axis scatter;
+    std::vector<double> u(10000);
+    std::vector<double> v(u.size());
+    std::vector<double> w(u.size());
+    for(std::size_t i = 0; i < u.size(); ++i)
+    {
+        u[i] = std::cos(i*0.01)*i;
+        v[i] = std::sin(i*0.01)*i;
+        w[i] = i;
+    }
+    scatter.draw({pgf::Color::FromW, {'*', 0.5, 0}, pgf::LineStyle::None, 1.,
+        1.}, std::move(u), std::move(v), {}, std::move(w));
+
+    pgf::PlotOptions options;
+    options.preview = true;
+    const double t = time_it([&]()
+    {
+        pgf::plot(dir + "/preview", {&line, &heatmap, &scatter}, options);
+    });
+    report("preview", t, 1, 0);
+}
+
+// Samples a field costing a few hundred nanoseconds per point through the
+// type-erased and templated `mesh_grid`.
+static void bench_mesh_grid(std::size_t res)
+{
+    auto f = [](double x, double y)
+    {
+        double z = 0.;
+        for(int k = 1; k <= 16; ++k)
+        {
+            z += std::sin(k*x)*std::cos(k*y)/k;
+        }
+        return z;
+    };
+    const std::function<double(double, double)> g = f;
+    const double tErased = time_it([&]()
+    {
+        pgf::mesh_grid(g, 0., 1., 0., 1., res);
+    });
+    report("mesh_grid, std::function", tErased, res*res, 0);
+    const double tTemplate = time_it([&]()
+    {
+        pgf::mesh_grid(f, 0., 1., 0., 1., res);
+    });
+    report("mesh_grid, template", tTemplate, res*res, 0);
+}
+
+#ifdef OS_UNIX
+// Runs `true` by `fork` and `exec`, as `system_call` used to.
+static void fork_exec()
+{
+    const auto pid = fork();
+    if(pid == 0)
+    {
+        execlp("true", "true", static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    int status;
+    if(pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status))
+    {
+        throw std::runtime_error("Failed to fork.");
+    }
+}
+#endif
+
+// Runs `true` `NumRuns` times through `system_call` and, on Unix, `fork`,
+// while this process holds 0 to 2 GiB more memory.
+static void bench_spawn()
+{
+    constexpr std::size_t NumRuns = 50;
+    for(const std::size_t mib : {0, 256, 1024, 2048})
+    {
+        std::vector<char> ballast;
+        try
+        {
+            // Touched, so it's resident.
+            ballast.assign(mib << 20, 1);
+        }
+        catch(const std::bad_alloc&)
+        {
+            std::printf("%-40s failed: out of memory\n", ("spawn, " + std::
+                to_string(mib) + " MiB").c_str());
+            continue;
+        }
+        try
+        {
+            const double tSpawn = time_it([&]()
+            {
+                for(std::size_t i = 0; i < NumRuns; ++i)
+                {
+                    pgf::system_call("true", {});
+                }
+            });
+            std::printf("%-40s %9.3f ms per process\n", ("spawn, system_call, "
+                + std::to_string(mib) + " MiB").c_str(), 1e3*tSpawn/NumRuns);
+#ifdef OS_UNIX
+            const double tFork = time_it([&]()
+            {
+                for(std::size_t i = 0; i < NumRuns; ++i)
+                {
+                    fork_exec();
+                }
+            });
+            std::printf("%-40s %9.3f ms per process\n", ("spawn, fork, " + std::
+                to_string(mib) + " MiB").c_str(), 1e3*tFork/NumRuns);
+#endif
+        }
+        catch(const std::exception& e)
+        {
+            std::printf("%-40s failed: %s\n", "spawn", e.what());
+            return;
+        }
+    }
+}
+
+// Renders 16 frames of a travelling wave one `plot` at a time and through
+// `animate`. Needs the external toolchain.
+static void bench_animate(const std::string& dir)
+{
+    constexpr std::size_t NumFrames = 16;
+    auto frame = [](std::size_t i, pgf::Axis& a)
+    {
+        std::vector<double> x(1000);
+        std::vector<double> y(x.size());
+        for(std::size_t j = 0; j < x.size(); ++j)
+        {
+            x[j] = j*1e-2;
+            y[j] = std::sin(x[j] - i*0.1);
+        }
+        a.draw(pgf::BasicLine, std::move(x), std::move(y));
+    };
+    pgf::Axis layout;
+    layout.setXLabel("$x$");
+    layout.setYLabel("$y$");
+
+    try
+    {
+        const double t = time_it([&]()
+        {
+            for(std::size_t i = 0; i < NumFrames; ++i)
+            {
+                pgf::Axis a = layout;
+                frame(i, a);
+                pgf::plot(dir + "/frame-" + std::to_string(i), {&a});
+            }
+        });
+        report("animate, plot per frame", t, NumFrames, 0);
+        const pgf::AnimationResult result = pgf::animate(dir + "/animate",
+            layout, NumFrames, frame);
+        report("animate, animate", result.seconds, NumFrames, 0);
+    }
+    catch(const std::exception& e)
+    {
+        std::printf("%-40s failed: %s\n", "animate", e.what());
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if(argc > 3 && std::string(argv[1]) == "ingest")
+    {
+        bench_ingest(argv[2], std::stoull(argv[3]));
+        return 0;
+    }
+
+    const std::size_t numRows = argc > 1 ? std::stoull(argv[1]) : 1000000;
+    const std::size_t numPoints = argc > 2 ? std::stoull(argv[2]) : 10000000;
+
+    const std::string outputDir = get_dir(argv[0]) + "/output";
+    std::filesystem::remove_all(outputDir);
+    std::filesystem::create_directory(outputDir);
+
+    bench_to_string(numRows);
+    bench_table(outputDir, numRows);
+    bench_decimate(numPoints);
+    bench_mesh_grid(1024);
+    bench_source(outputDir);
+    bench_emit(outputDir);
+    bench_plot(outputDir);
+    bench_spawn();
+    bench_pipeline(outputDir);
+    bench_preview(outputDir);
+    bench_animate(outputDir);
+
+    std::fflush(stdout);
+    for(const std::string mode : {"copy", "move", "view"})
+    {
+        const std::string cmd = std::string(argv[0]) + " ingest " + mode + " " +
+            std::to_string(numPoints);
+        if(std::system(cmd.c_str()))
+        {
+            std::fprintf(stderr, "Failed to run \"%s\".\n", cmd.c_str());
+        }
+    }
+}
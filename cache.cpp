@@ -0,0 +1,260 @@
+#include "compile.hpp"
+#include "hash.hpp"
+#include <filesystem>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <map>
+#include <fstream>
+#include <tuple>
+
+namespace
+{
+    std::atomic<std::uint64_t> hits(0);
+    std::atomic<std::uint64_t> misses(0);
+    std::atomic<std::uint64_t> evictions(0);
+
+    // The output, in either format, the archive and the file whose time is
+    // when the entry was last used. The output itself isn't touched, as the
+    // restored plot may be a hard link to it.
+    const std::string Extensions[] = {".png", ".pdf", ".zip", ".used"};
+
+    struct Entry
+    {
+        std::filesystem::file_time_type used;
+        std::uintmax_t size = 0;
+        std::vector<std::filesystem::path> files;
+    };
+
+    std::mutex mutex;
+    // Size of each cache directory this process has stored to, by its last
+    // walk plus what it has added since.
+    std::map<std::string, std::uintmax_t> totals;
+}
+
+// Name of the cached archive, which holds the source named after the plot.
+static std::string archive_name(const std::string& key, const std::string&
+    name)
+{
+    return key + "." + name + ".zip";
+}
+
+// Hard links `from` to `to`, or copies it if they're on different devices.
+static void link_or_copy(const std::filesystem::path& from, const std::
+    filesystem::path& to)
+{
+    std::filesystem::remove(to);
+    std::error_code ec;
+    std::filesystem::create_hard_link(from, to, ec);
+    if(ec)
+    {
+        std::filesystem::copy_file(from, to);
+    }
+}
+
+// Entries of the cache in `dir` by key, and their total size.
+static std::pair<std::map<std::string, Entry>, std::uintmax_t> scan(const
+    std::string& dir)
+{
+    std::map<std::string, Entry> entries;
+    std::uintmax_t total = 0;
+    for(const auto& n : std::filesystem::directory_iterator(dir))
+    {
+        const std::string ext = n.path().extension().string();
+        std::error_code ec;
+        if(std::find(std::begin(Extensions), std::end(Extensions), ext) == std::
+            end(Extensions) || !n.is_regular_file(ec))
+        {
+            continue;
+        }
+        // Grouped by key, which is everything before the first dot.
+        const std::string filename = n.path().filename().string();
+        Entry& entry = entries[filename.substr(0, filename.find('.'))];
+        entry.files.push_back(n.path());
+        const std::uintmax_t size = n.file_size(ec);
+        if(!ec)
+        {
+            entry.size += size;
+            total += size;
+        }
+        if(ext == ".used")
+        {
+            entry.used = n.last_write_time(ec);
+        }
+    }
+    return {entries, total};
+}
+
+// Records that the entry `key` in `dir` was just used.
+static void mark_used(const std::string& dir, const std::string& key)
+{
+    const std::filesystem::path path = std::filesystem::path(dir)/(key +
+        ".used");
+    if(!std::filesystem::exists(path))
+    {
+        std::ofstream out(path);
+    }
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::
+        clock::now());
+}
+
+std::string pgfplotter::cache_dir(const PlotOptions& options)
+{
+    return options.cacheDir.empty() ? (std::filesystem::temp_directory_path()/
+        "pgfplotter"/"cache").string() : options.cacheDir;
+}
+
+std::string pgfplotter::cache_key(const std::string& src, const std::string&
+    dataDir, const PlotStats& stats, const PlotOptions& options)
+{
+    // Only what this plot wrote, as anything else left in the directory isn't
+    // used, and not the Makefile, which only depends on the plot name, the
+    // options hashed here and the location of the precompiled preamble.
+    Hash hash;
+    hash.field(toolchain_version());
+    hash.field(std::to_string(static_cast<int>(options.pipeline)));
+    hash.field(std::to_string(static_cast<int>(options.format)));
+    hash.field(std::to_string(options.dpi));
+    hash.field(src);
+    for(const auto& n : stats.subplots)
+    {
+        for(const auto& m : n.files)
+        {
+            const std::string path = dataDir + "/" + m;
+            hash.field(m);
+            hash.field(std::to_string(std::filesystem::file_size(path)));
+            hash.file(path);
+        }
+    }
+    return hash.hex();
+}
+
+bool pgfplotter::cache_restore(const std::string& dir, const std::string& key,
+    const std::string& outputPath)
+{
+    const std::filesystem::path cached = std::filesystem::path(dir)/(key +
+        std::filesystem::path(outputPath).extension().string());
+    try
+    {
+        link_or_copy(cached, outputPath);
+    }
+    catch(const std::exception&)
+    {
+        ++misses;
+        return false;
+    }
+    ++hits;
+    try
+    {
+        mark_used(dir, key);
+    }
+    catch(const std::exception&)
+    {
+        // Only makes the entry more likely to be evicted.
+    }
+    return true;
+}
+
+bool pgfplotter::cache_restore_archive(const std::string& dir, const std::
+    string& key, const std::string& name, const std::string& zipPath)
+{
+    try
+    {
+        link_or_copy(std::filesystem::path(dir)/archive_name(key, name),
+            zipPath);
+    }
+    catch(const std::exception&)
+    {
+        return false;
+    }
+    return true;
+}
+
+void pgfplotter::cache_store(const std::string& dir, const std::string& key,
+    const std::string& name, const std::string& outputPath, const std::string&
+    zipPath, std::uintmax_t maxSize)
+{
+    std::filesystem::create_directories(dir);
+    std::lock_guard<std::mutex> lock(mutex);
+    // Walked once, after which entries are counted as they're added.
+    const auto it = totals.find(dir);
+    std::uintmax_t& total = it != totals.end() ? it->second : (totals[dir] =
+        scan(dir).second);
+
+    const std::string outputName = key + std::filesystem::path(outputPath).
+        extension().string();
+    for(const std::string& n : {outputName, archive_name(key, name)})
+    {
+        const std::string& from = n == outputName ? outputPath : zipPath;
+        const std::filesystem::path to = std::filesystem::path(dir)/n;
+        if(from.empty() || std::filesystem::exists(to))
+        {
+            continue;
+        }
+        // Copied rather than linked so later changes to the output can't
+        // reach the cache, and renamed into place so concurrent lookups never
+        // see a partial file.
+        const std::filesystem::path tmp = to.string() + ".tmp" + std::
+            to_string(std::random_device()());
+        try
+        {
+            std::filesystem::copy_file(from, tmp);
+            total += std::filesystem::file_size(tmp);
+            std::filesystem::rename(tmp, to);
+        }
+        catch(...)
+        {
+            std::error_code ec;
+            std::filesystem::remove(tmp, ec);
+            throw;
+        }
+    }
+    mark_used(dir, key);
+    if(total <= maxSize)
+    {
+        return;
+    }
+
+    // Other processes may have added or evicted entries since, so the
+    // directory is walked again before evicting the least recently used.
+    std::map<std::string, Entry> entries;
+    std::tie(entries, total) = scan(dir);
+    std::vector<std::pair<std::filesystem::file_time_type, std::string>> order;
+    order.reserve(entries.size());
+    for(const auto& n : entries)
+    {
+        order.push_back({n.second.used, n.first});
+    }
+    std::sort(order.begin(), order.end());
+    for(const auto& n : order)
+    {
+        if(total <= maxSize)
+        {
+            break;
+        }
+        for(const auto& m : entries[n.second].files)
+        {
+            std::error_code ec;
+            std::filesystem::remove(m, ec);
+        }
+        total -= entries[n.second].size;
+        ++evictions;
+    }
+}
+
+pgfplotter::CacheStats pgfplotter::cache_stats()
+{
+    CacheStats stats;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.evictions = evictions;
+    return stats;
+}
+
+void pgfplotter::reset_cache_stats()
+{
+    hits = 0;
+    misses = 0;
+    evictions = 0;
+}
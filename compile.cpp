@@ -0,0 +1,1029 @@
+#include "compile.hpp"
+#include "detect_os.hpp"
+#include "parallel.hpp"
+#include "zip.hpp"
+#include "hash.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <chrono>
+#include <mutex>
+#ifdef OS_WINDOWS
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <spawn.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/fcntl.h>
+#include <signal.h>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+
+extern char** environ;
+#endif
+
+namespace
+{
+    std::mutex hookMutex;
+    pgfplotter::StatsHook statsHook;
+
+    // Output of a failed process kept for the error message, in bytes.
+    constexpr std::size_t TailSize = 1024;
+}
+
+// Appends `size` bytes from `data` to `tail`, keeping at least the last
+// `TailSize`.
+static void append_tail(std::string& tail, const char* data, std::size_t size)
+{
+    tail.append(data, size);
+    if(tail.size() > 2*TailSize)
+    {
+        tail.erase(0, tail.size() - TailSize);
+    }
+}
+
+// The end of `tail` to finish an error message with.
+static std::string with_tail(std::string tail)
+{
+    if(tail.size() > TailSize)
+    {
+        tail.erase(0, tail.size() - TailSize);
+    }
+    const auto end = tail.find_last_not_of(" \t\r\n");
+    if(end == std::string::npos)
+    {
+        return ".";
+    }
+    tail.erase(end + 1);
+    return ":\n" + tail;
+}
+
+#ifdef OS_WINDOWS
+void pgfplotter::system_call(const std::string& file, const std::vector<std::
+    string>& args, std::string* output, ProcessResult* result, const
+    ProcessLimits&)
+{
+    std::string cmd = file;
+    for(const auto& n : args)
+    {
+        cmd += " \"" + n + "\"";
+    }
+    STARTUPINFOA si = {};
+    si.cb = sizeof(si);
+    si.dwFlags = STARTF_USESHOWWINDOW;
+    si.wShowWindow = SW_HIDE;
+    SECURITY_ATTRIBUTES sa = {};
+    sa.nLength = sizeof(sa);
+    sa.bInheritHandle = true;
+    sa.lpSecurityDescriptor = nullptr;
+    HANDLE g_hChildStd_IN_Rd = nullptr;
+    HANDLE g_hChildStd_IN_Wr = nullptr;
+    HANDLE g_hChildStd_OUT_Rd = nullptr;
+    HANDLE g_hChildStd_OUT_Wr = nullptr;
+    if(!CreatePipe(&g_hChildStd_OUT_Rd, &g_hChildStd_OUT_Wr, &sa, 0))
+    {
+        throw std::runtime_error("Failed to create output pipe: Error " + std::
+            to_string(GetLastError()) + ".");
+    }
+    if(!SetHandleInformation(g_hChildStd_OUT_Rd, HANDLE_FLAG_INHERIT, 0))
+    {
+        throw std::runtime_error("Failed to set output pipe to inherit: Error "
+            + std::to_string(GetLastError()) + ".");
+    }
+    if(!CreatePipe(&g_hChildStd_IN_Rd, &g_hChildStd_IN_Wr, &sa, 0))
+    {
+        throw std::runtime_error("Failed to create input pipe: Error " + std::
+            to_string(GetLastError()) + ".");
+    }
+    if(!SetHandleInformation(g_hChildStd_IN_Wr, HANDLE_FLAG_INHERIT, 0))
+    {
+        throw std::runtime_error("Failed to set input pipe to inherit: Error " +
+            std::to_string(GetLastError()) + ".");
+    }
+    si.hStdError = g_hChildStd_OUT_Wr;
+    si.hStdOutput = g_hChildStd_OUT_Wr;
+    si.hStdInput = g_hChildStd_IN_Rd;
+    si.dwFlags |= STARTF_USESTDHANDLES;
+    PROCESS_INFORMATION pi;
+    if(!CreateProcessA(nullptr, const_cast<char*>(cmd.c_str()), nullptr,
+        nullptr, true, CREATE_NO_WINDOW, nullptr, nullptr, &si, &pi))
+    {
+        throw std::runtime_error("Failed to create process: Error " + std::
+            to_string(GetLastError()) + ".");
+    }
+    // Drain the output so the child cannot block on a full pipe.
+    CloseHandle(g_hChildStd_OUT_Wr);
+    g_hChildStd_OUT_Wr = nullptr;
+    std::string tail;
+    char buf[4096];
+    DWORD numRead;
+    while(ReadFile(g_hChildStd_OUT_Rd, buf, sizeof(buf), &numRead, nullptr) &&
+        numRead)
+    {
+        if(output)
+        {
+            output->append(buf, numRead);
+        }
+        else
+        {
+            append_tail(tail, buf, numRead);
+        }
+    }
+    CloseHandle(g_hChildStd_OUT_Rd);
+    WaitForSingleObject(pi.hProcess, INFINITE);
+    DWORD exitCode;
+    if(!GetExitCodeProcess(pi.hProcess, &exitCode))
+    {
+        throw std::runtime_error("Failed to get exit code: Error " + std::
+            to_string(GetLastError()) + ".");
+    }
+    if(exitCode == STILL_ACTIVE)
+    {
+        throw std::runtime_error("Wait returned before process completed.");
+    }
+    if(result)
+    {
+        result->exitCode = static_cast<int>(exitCode);
+    }
+    if(exitCode)
+    {
+        throw std::runtime_error("System call returned " + std::to_string(
+            exitCode) + with_tail(tail));
+    }
+    CloseHandle(pi.hProcess);
+    CloseHandle(pi.hThread);
+    CloseHandle(g_hChildStd_IN_Rd);
+    g_hChildStd_IN_Rd = nullptr;
+}
+#else
+// Creates a pipe closed in spawned processes, throwing on failure.
+static void make_pipe(int fds[2])
+{
+#ifdef OS_LINUX
+    // Atomically, so processes spawned by other threads meanwhile can't keep
+    // the write end open.
+    const bool failed = pipe2(fds, O_CLOEXEC) < 0;
+#else
+    const bool failed = pipe(fds) < 0;
+    if(!failed)
+    {
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    }
+#endif
+    if(failed)
+    {
+        throw std::runtime_error("Failed to create output pipe: " + std::string(
+            std::strerror(errno)) + ".");
+    }
+}
+
+void pgfplotter::system_call(const std::string& file, const std::vector<std::
+    string>& args, std::string* output, ProcessResult* result, const
+    ProcessLimits& limits)
+{
+    // `posix_spawn` can't set resource limits, so a shell sets them and then
+    // runs the program in its place.
+    std::vector<std::string> shell;
+    if(limits.cpuSeconds > 0. || limits.memory)
+    {
+        std::string script;
+        if(limits.cpuSeconds > 0.)
+        {
+            script += "ulimit -t " + std::to_string(static_cast<std::uint64_t>(
+                std::ceil(limits.cpuSeconds))) + " && ";
+        }
+        if(limits.memory)
+        {
+            // In kilobytes.
+            script += "ulimit -v " + std::to_string(std::max<std::uint64_t>(
+                limits.memory/1024, 1)) + " && ";
+        }
+        shell = {"sh", "-c", script + "exec \"$0\" \"$@\"", file};
+    }
+    std::vector<char*> argv;
+    for(const auto& n : shell)
+    {
+        argv.push_back(const_cast<char*>(n.c_str()));
+    }
+    if(shell.empty())
+    {
+        argv.push_back(const_cast<char*>(file.c_str()));
+    }
+    for(const auto& n : args)
+    {
+        argv.push_back(const_cast<char*>(n.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    // Standard output goes to `output` if given, and everything else to the
+    // end of the error message.
+    int outFds[2] = {-1, -1};
+    int errFds[2] = {-1, -1};
+    auto close_all = [&]()
+    {
+        for(const int n : {outFds[0], outFds[1], errFds[0], errFds[1]})
+        {
+            if(n >= 0)
+            {
+                close(n);
+            }
+        }
+    };
+    try
+    {
+        make_pipe(errFds);
+        if(output)
+        {
+            make_pipe(outFds);
+        }
+    }
+    catch(...)
+    {
+        close_all();
+        throw;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    int error = posix_spawn_file_actions_init(&actions);
+    if(!error)
+    {
+        error = posix_spawnattr_init(&attr);
+        if(error)
+        {
+            posix_spawn_file_actions_destroy(&actions);
+        }
+    }
+    if(error)
+    {
+        close_all();
+        throw std::runtime_error("Failed to set up process: " + std::string(
+            std::strerror(error)) + ".");
+    }
+    error = posix_spawn_file_actions_adddup2(&actions, output ? outFds[1] :
+        errFds[1], 1);
+    if(!error)
+    {
+        error = posix_spawn_file_actions_adddup2(&actions, errFds[1], 2);
+    }
+    // In its own process group, so everything it starts can be killed with
+    // it.
+    const bool grouped = limits.seconds > 0. || limits.cpuSeconds > 0. ||
+        limits.memory;
+    if(!error && grouped)
+    {
+        error = posix_spawnattr_setpgroup(&attr, 0);
+        if(!error)
+        {
+            error = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+        }
+    }
+    // Unlike `fork`, this doesn't copy the page tables of the calling process,
+    // so it's as fast for large processes and can't fail for lack of memory to
+    // commit to a copy.
+    pid_t pid;
+    if(!error)
+    {
+        error = posix_spawnp(&pid, argv[0], &actions, &attr, argv.data(),
+            environ);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if(error)
+    {
+        close_all();
+        throw std::runtime_error("Failed to run \"" + file + "\": " + std::
+            string(std::strerror(error)) + ".");
+    }
+    close(errFds[1]);
+    errFds[1] = -1;
+    if(output)
+    {
+        close(outFds[1]);
+        outFds[1] = -1;
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::
+        duration_cast<std::chrono::steady_clock::duration>(std::chrono::
+        duration<double>(limits.seconds));
+    bool timedOut = false;
+    // Milliseconds until the deadline, capped to fit `poll`, or -1 if there's
+    // none.
+    auto time_left = [&]()
+    {
+        if(limits.seconds <= 0.)
+        {
+            return -1;
+        }
+        const auto left = std::chrono::duration_cast<std::chrono::
+            milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        return static_cast<int>(std::max<decltype(left)>(0, std::min<
+            decltype(left)>(left, 3600000)));
+    };
+    auto kill_group = [&]()
+    {
+        kill(-pid, SIGKILL);
+        timedOut = true;
+    };
+
+    // Drain both pipes so the child can't block on a full one.
+    std::string tail;
+    pollfd fds[2] = {{errFds[0], POLLIN, 0}, {outFds[0], POLLIN, 0}};
+    int numOpen = output ? 2 : 1;
+    char buf[4096];
+    bool exited = false;
+    while(numOpen && !timedOut)
+    {
+        // Anything it left running, e.g. in the background or after a limit
+        // killed the process that would have waited for it, would only hold
+        // the pipes open, so once it has exited only what it wrote is read.
+        if(!exited)
+        {
+            siginfo_t info;
+            info.si_pid = 0;
+            if(!waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) &&
+                info.si_pid)
+            {
+                exited = true;
+                if(grouped)
+                {
+                    kill(-pid, SIGKILL);
+                }
+            }
+        }
+        // Checking now and then whether it has exited.
+        const int timeLeft = time_left();
+        const int numReady = poll(fds, 2, exited ? 0 : timeLeft < 0 ? 100 :
+            std::min(timeLeft, 100));
+        if(numReady < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        if(!numReady)
+        {
+            if(exited)
+            {
+                break;
+            }
+            if(!time_left())
+            {
+                kill_group();
+            }
+            continue;
+        }
+        for(auto& n : fds)
+        {
+            if(n.fd < 0 || !n.revents)
+            {
+                continue;
+            }
+            const ssize_t size = read(n.fd, buf, sizeof(buf));
+            if(size > 0)
+            {
+                if(n.fd == outFds[0])
+                {
+                    output->append(buf, size);
+                }
+                else
+                {
+                    append_tail(tail, buf, size);
+                }
+            }
+            else if(!size || errno != EINTR)
+            {
+                n.fd = -1;
+                --numOpen;
+            }
+        }
+    }
+    close_all();
+
+    int status;
+    // Includes the peak memory and CPU time of the children it waited for.
+    rusage usage;
+    bool reaped = false;
+    // It may close its output before exiting.
+    while(limits.seconds > 0. && !timedOut)
+    {
+        const pid_t waited = wait4(pid, &status, WNOHANG, &usage);
+        if(waited == pid)
+        {
+            reaped = true;
+            break;
+        }
+        if(waited < 0 && errno != EINTR)
+        {
+            break;
+        }
+        if(!time_left())
+        {
+            kill_group();
+        }
+        else
+        {
+            usleep(10000);
+        }
+    }
+    if(!reaped)
+    {
+        pid_t waited;
+        while((waited = wait4(pid, &status, 0, &usage)) < 0 && errno == EINTR);
+        if(waited < 0)
+        {
+            throw std::runtime_error("Wait failed.");
+        }
+    }
+    if(result)
+    {
+        result->exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#ifdef OS_MACOS
+        result->peakMemory = static_cast<std::uint64_t>(usage.ru_maxrss);
+#else
+        // In kilobytes.
+        result->peakMemory = 1024*static_cast<std::uint64_t>(usage.ru_maxrss);
+#endif
+        result->cpuSeconds = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+            (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec)*1e-6;
+        result->signal = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+        result->timedOut = timedOut;
+    }
+    if(timedOut)
+    {
+        throw std::runtime_error("Killed after " + std::to_string(
+            limits.seconds) + " s" + with_tail(tail));
+    }
+    if(!WIFEXITED(status))
+    {
+        throw std::runtime_error("System call did not exit normally" +
+            with_tail(tail));
+    }
+    const auto exitCode = WEXITSTATUS(status);
+    if(exitCode)
+    {
+        throw std::runtime_error("System call returned " + std::to_string(
+            exitCode) + with_tail(tail));
+    }
+}
+#endif
+
+void pgfplotter::split_path(const std::string& path, std::string& dir, std::
+    string& name)
+{
+    const std::filesystem::path p(path);
+    dir = p.parent_path().string();
+    name = p.filename().string();
+}
+
+void pgfplotter::report_stats(const std::string& path, PlotStats& stats,
+    PlotStats* target)
+{
+    StatsHook hook;
+    {
+        std::lock_guard<std::mutex> lock(hookMutex);
+        hook = statsHook;
+    }
+    if(hook)
+    {
+        try
+        {
+            hook(path, stats);
+        }
+        catch(const std::exception& e)
+        {
+            stats.warnings.push_back("Stats hook failed for \"" + path + "\": "
+                + e.what());
+        }
+    }
+    if(target)
+    {
+        *target = stats;
+    }
+}
+
+std::string pgfplotter::warning_lines(const PlotStats& stats)
+{
+    std::string warnings;
+    for(const auto& n : stats.warnings)
+    {
+        warnings += (warnings.empty() ? "" : "\n") + n;
+    }
+    return warnings;
+}
+
+void pgfplotter::print_warnings(const std::string& warnings)
+{
+    std::istringstream in(warnings);
+    for(std::string line; std::getline(in, line);)
+    {
+        std::cerr << "Warning: " << line << std::endl;
+    }
+}
+
+void pgfplotter::set_stats_hook(StatsHook hook)
+{
+    std::lock_guard<std::mutex> lock(hookMutex);
+    statsHook = std::move(hook);
+}
+
+// Renames `from` to `to`, or copies and deletes it if they're on different
+// devices.
+static void move_path(const std::filesystem::path& from, const std::
+    filesystem::path& to)
+{
+    std::error_code ec;
+    std::filesystem::rename(from, to, ec);
+    if(ec)
+    {
+        std::filesystem::copy(from, to, std::filesystem::copy_options::
+            recursive | std::filesystem::copy_options::overwrite_existing);
+        std::filesystem::remove_all(from);
+    }
+}
+
+std::string pgfplotter::output_name(const std::string& path, const
+    PlotOptions& options)
+{
+    if(options.preview || options.format == OutputFormat::PNG)
+    {
+        return path + ".png";
+    }
+    return options.format == OutputFormat::PDF ? path + ".pdf" : path + Suffix;
+}
+
+std::string pgfplotter::scratch_path(const std::string& path, const
+    PlotOptions& options)
+{
+    if(options.scratchDir.empty())
+    {
+        return path;
+    }
+    try
+    {
+        std::filesystem::create_directories(options.scratchDir);
+    }
+    catch(const std::exception& e)
+    {
+        throw std::runtime_error("Failed to create scratch directory \"" +
+            options.scratchDir + "\": " + e.what());
+    }
+    // Plots of the same name in different directories mustn't share one.
+    Hash hash;
+    hash.update(std::filesystem::absolute(path).lexically_normal().string());
+    return (std::filesystem::path(options.scratchDir)/std::filesystem::path(
+        path).filename()).string() + "-" + hash.hex().substr(0, 16);
+}
+
+void pgfplotter::create_data_dir(const std::string& path)
+{
+    try
+    {
+        if(std::filesystem::exists(path + Suffix))
+        {
+            if(!std::filesystem::is_directory(path + Suffix))
+            {
+                throw std::runtime_error("Path already exists but is not a dire"
+                    "ctory.");
+            }
+        }
+        else
+        {
+            std::filesystem::create_directory(path + Suffix);
+        }
+    }
+    catch(const std::exception& e)
+    {
+        throw std::runtime_error("Failed to create plot data directory \"" +
+            path + Suffix + "\": " + e.what());
+    }
+}
+
+const std::string& pgfplotter::toolchain_version()
+{
+    static const std::string version = []()
+    {
+        std::string s;
+        system_call("lualatex", {"--version"}, &s);
+        return s.substr(0, s.find('\n'));
+    }();
+    return version;
+}
+
+pgfplotter::Recipe::Recipe(const std::string& job, const PlotOptions&
+    options) : job(job)
+{
+    if(job.find('\t') != std::string::npos || job.find(' ') != std::string::
+        npos)
+    {
+        throw std::runtime_error("Plot name cannot contain whitespace.");
+    }
+
+    // Each stage is its own target, with intermediates marked secondary so
+    // stages can be run by separate `make` calls without being redone.
+    const std::string unpressed = job + "_unpressed.pdf";
+    std::string pdf = job + ".pdf";
+    stages = {{"lualatex", unpressed}};
+    switch(options.pipeline)
+    {
+    case Pipeline::PostScript:
+        stages.push_back({"pdf2ps", job + ".ps"});
+        stages.push_back({"ps2pdf14", pdf});
+        break;
+    case Pipeline::Prepress:
+        stages.push_back({"gs", pdf});
+        break;
+    case Pipeline::Direct:
+        pdf = unpressed;
+        break;
+    }
+    stages.push_back({"pdftoppm", job + ".png"});
+
+    {
+        std::ostringstream out;
+        out << "print-% : ; @echo $* = $($*)" << std::endl << std::endl;
+        out << "export TERM = dumb" << std::endl << std::endl;
+        // Local to the machine, so passed by `run` rather than written here.
+        out << "# Precompiled preamble, if any: make FMT=path/to/format" <<
+            std::endl;
+        out << "FMT =" << std::endl << std::endl;
+        out << ".SECONDARY:";
+        for(std::size_t i = 0; i + 1 < stages.size(); ++i)
+        {
+            out << " " << stages[i].target;
+        }
+        out << std::endl << std::endl;
+        out << job << ".png: " << pdf << std::endl;
+        out << "\tpdftoppm -png -r " << options.dpi << " " << pdf << " > " <<
+            job << ".png \\" << std::endl;
+        out << "\t    && $(RM) " << pdf << std::endl;
+        out << std::endl;
+        if(options.pipeline == Pipeline::PostScript)
+        {
+            out << "ifeq ($(OS), Windows_NT)" << std::endl;
+            out << job << ".pdf: " << job << ".ps" << std::endl;
+            out << "\tMSYS2_ARG_CONV_EXCL=\"*\" ps2pdf14 -dPDFSETTINGS=/prepre"
+                "ss " << job << ".ps " << job << ".pdf \\" << std::endl;
+            out << "\t    && $(RM) " << job << ".ps" << std::endl;
+            out << "else" << std::endl;
+            out << job << ".pdf: " << job << ".ps" << std::endl;
+            out << "\tps2pdf14 -dPDFSETTINGS=/prepress " << job << ".ps " <<
+                job << ".pdf \\" << std::endl;
+            out << "\t    && $(RM) " << job << ".ps" << std::endl;
+            out << "endif" << std::endl;
+            out << std::endl;
+            out << job << ".ps: " << unpressed << std::endl;
+            out << "\tpdf2ps " << unpressed << " \\" << std::endl;
+            out << "\t    && mv " << job << "_unpressed.ps " << job << ".ps "
+                "\\" << std::endl;
+            out << "\t    && $(RM) " << unpressed << std::endl;
+            out << std::endl;
+        }
+        else if(options.pipeline == Pipeline::Prepress)
+        {
+            // What `ps2pdf14` runs, minus the PostScript file.
+            const std::string gs = "gs -q -dSAFER -dBATCH -dNOPAUSE -sDEVICE=p"
+                "dfwrite -dCompatibilityLevel=1.4 -dPDFSETTINGS=/prepress -sOut"
+                "putFile=" + job + ".pdf " + unpressed + " \\";
+            out << "ifeq ($(OS), Windows_NT)" << std::endl;
+            out << job << ".pdf: " << unpressed << std::endl;
+            out << "\tMSYS2_ARG_CONV_EXCL=\"*\" " << gs << std::endl;
+            out << "\t    && $(RM) " << unpressed << std::endl;
+            out << "else" << std::endl;
+            out << job << ".pdf: " << unpressed << std::endl;
+            out << "\t" << gs << std::endl;
+            out << "\t    && $(RM) " << unpressed << std::endl;
+            out << "endif" << std::endl;
+            out << std::endl;
+        }
+        out << job << "_unpressed.pdf: " << job << ".tex $(wildcard *.data) $"
+            "(wildcard *.surf)" << std::endl;
+        out << "\tlualatex $(if $(FMT),-fmt=\"$(FMT)\") -halt-on-error -interac"
+            "tion=batchmode " << job << " \\" << std::endl;
+        out << "\t    && mv " << job << ".pdf " << job << "_unpressed.pdf \\"
+            << std::endl;
+        out << "\t    && $(RM) " << job << ".aux \\" << std::endl;
+        out << "\t    && $(RM) " << job << ".log" << std::endl;
+        makefile = out.str();
+    }
+
+    // The Makefile always goes as far as the PNG, so it can still be made
+    // later, but only the stages the format needs are run.
+    switch(options.format)
+    {
+    case OutputFormat::PNG:
+        product = job + ".png";
+        extension = ".png";
+        break;
+    case OutputFormat::PDF:
+        stages.pop_back();
+        product = pdf;
+        extension = ".pdf";
+        break;
+    case OutputFormat::TeX:
+        stages.clear();
+        break;
+    }
+}
+
+pgfplotter::Build::Build(const std::string& path, const std::string& src,
+    const PlotOptions& options, PlotStats stats, std::shared_ptr<const Recipe>
+    recipe) : path(path), data(scratch_path(path, options) + Suffix), recipe(
+    recipe), format(options.format), archive(options.archive), threads(
+    options.threads), limits{options.stageTimeout, options.cpuLimit, options.
+    memoryLimit}, timeout(options.timeout), stats(std::move(stats)), target(
+    options.stats), cacheSize(options.cacheSize)
+{
+    if(path.find('"') != std::string::npos)
+    {
+        throw std::runtime_error("Plot path cannot contain double quote charact"
+            "er.");
+    }
+
+    split_path(path, dir, name);
+    if(!recipe)
+    {
+        this->recipe = std::make_shared<const Recipe>(name, options);
+    }
+
+    {
+        const std::string texPath = data + "/" + this->recipe->job + ".tex";
+        std::ofstream out(texPath);
+        if(!out)
+        {
+            throw std::runtime_error("Unable to open output file \"" + texPath +
+                "\".");
+        }
+        out << src << std::endl;
+    }
+
+    {
+        const std::string makefilePath = data + "/Makefile";
+        std::ofstream out(makefilePath);
+        if(!out)
+        {
+            throw std::runtime_error("Unable to open output file \"" +
+                makefilePath + "\".");
+        }
+        out << this->recipe->makefile;
+    }
+
+    // Not needed, and not worth building, if nothing is compiled here.
+    if(options.precompilePreamble && options.format != OutputFormat::TeX)
+    {
+        std::string warning;
+        formatPath = preamble_format(options.formatDir, warning);
+        if(!warning.empty())
+        {
+            this->stats.warnings.push_back(warning);
+        }
+    }
+
+    if(options.cache && options.format != OutputFormat::TeX)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        try
+        {
+            cacheDir = cache_dir(options);
+            cacheKey = cache_key(src, data, this->stats, options);
+        }
+        catch(const std::exception& e)
+        {
+            this->stats.warnings.push_back("Render cache disabled for \"" +
+                path + "\": " + e.what());
+            cacheKey.clear();
+        }
+        record("hash", start);
+    }
+}
+
+bool pgfplotter::Build::restore()
+{
+    if(cacheKey.empty())
+    {
+        return false;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    restored = cache_restore(cacheDir, cacheKey, data + "/" + recipe->product);
+    record("cache lookup", start);
+    return restored;
+}
+
+#ifdef OS_WINDOWS
+static bool killed_for_cpu(const pgfplotter::ProcessResult&, const std::
+    string&, double)
+{
+    return false;
+}
+#else
+// Whether `make`, or the recipe it reports failing in `message` with its
+// shell's exit status of 128 plus the signal, was killed by a CPU time limit
+// of `cpuSeconds`. Reaching the hard limit, which `ulimit -t` also sets, is
+// SIGKILL rather than SIGXCPU, so SIGKILL only counts once the CPU time used
+// reaches the limit.
+static bool killed_for_cpu(const pgfplotter::ProcessResult& result, const
+    std::string& message, double cpuSeconds)
+{
+    int signal = result.signal;
+    const auto i = message.rfind("] Error ");
+    if(!signal && i != std::string::npos)
+    {
+        signal = std::atoi(message.c_str() + i + 8) - 128;
+    }
+    return signal == SIGXCPU || (signal == SIGKILL && result.cpuSeconds >=
+        cpuSeconds);
+}
+#endif
+
+void pgfplotter::Build::run(const Stage& stage)
+{
+    const std::string failed = "Failed to plot \"" + name + recipe->
+        extension + "\": " + stage.name + ": ";
+    // The time left for the plot, if less than the stage limit.
+    ProcessLimits stageLimits = limits;
+    const bool plotLimited = timeout > 0. && (limits.seconds <= 0. || timeout
+        - toolchainSeconds < limits.seconds);
+    if(plotLimited)
+    {
+        stageLimits.seconds = timeout - toolchainSeconds;
+        if(stageLimits.seconds <= 0.)
+        {
+            report_stats(path, stats, target);
+            throw LimitError(failed + "Time limit of " + Axis::ToString(
+                timeout) + " s already reached.", stage.name, Limit::Timeout);
+        }
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    ProcessResult result;
+    try
+    {
+        std::vector<std::string> args = {"-s", "--no-print-directory", "-C",
+            data, stage.target};
+        if(!formatPath.empty())
+        {
+            args.push_back("FMT=" + formatPath);
+        }
+        system_call("make", args, nullptr, &result, stageLimits);
+    }
+    catch(const std::exception& e)
+    {
+        record(stage.name, start, result);
+        toolchainSeconds += stats.stages.back().seconds;
+        report_stats(path, stats, target);
+        if(result.timedOut)
+        {
+            throw LimitError(failed + "Exceeded " + (plotLimited ? "plot" :
+                "stage") + " time limit of " + Axis::ToString(plotLimited ?
+                timeout : limits.seconds) + " s.", stage.name, plotLimited ?
+                Limit::Timeout : Limit::StageTimeout);
+        }
+        if(limits.cpuSeconds > 0. && killed_for_cpu(result, e.what(), limits.
+            cpuSeconds))
+        {
+            throw LimitError(failed + "Exceeded CPU time limit of " + Axis::
+                ToString(limits.cpuSeconds) + " s.", stage.name, Limit::CPU);
+        }
+        throw PlotError(failed + e.what());
+    }
+    record(stage.name, start, result);
+    toolchainSeconds += stats.stages.back().seconds;
+}
+
+void pgfplotter::Build::record(const std::string& stage, std::chrono::
+    steady_clock::time_point start, const ProcessResult& result)
+{
+    stats.stages.push_back({stage, std::chrono::duration<double>(std::chrono::
+        steady_clock::now() - start).count(), result.exitCode, result.
+        peakMemory});
+}
+
+std::string pgfplotter::Build::finish(bool deleteData)
+{
+    const std::string newPath = (dir.empty() ? "." : dir) + "/" + name +
+        recipe->extension;
+    if(!recipe->product.empty())
+    {
+        try
+        {
+            move_path(data + "/" + recipe->product, newPath);
+        }
+        catch(const std::exception& e)
+        {
+            report_stats(path, stats, target);
+            throw PlotError("Failed to move \"" + name + recipe->extension +
+                "\": " + e.what());
+        }
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const std::string zipPath = path + Suffix + ".zip";
+    const bool archiveData = archive && !deleteData;
+    bool archived = archiveData;
+    if(archiveData)
+    {
+        try
+        {
+            // Replaced rather than updated, as it may be linked to the cache.
+            std::filesystem::remove(zipPath);
+            if(!restored || !cache_restore_archive(cacheDir, cacheKey, recipe->
+                job, zipPath))
+            {
+                ThreadBudget budget(threads ? threads : threadBudget);
+                zip_directory(data, zipPath);
+            }
+            std::filesystem::remove_all(data);
+        }
+        catch(const std::exception& e)
+        {
+            stats.warnings.push_back("Failed to archive and clean up plot data"
+                " for \"" + path + "\": " + e.what());
+            archived = false;
+        }
+        record("archive", start);
+    }
+    // The source and data files are all there is of TeX output.
+    else if(format == OutputFormat::TeX)
+    {
+        if(data != path + Suffix)
+        {
+            try
+            {
+                std::filesystem::remove_all(path + Suffix);
+                move_path(data, path + Suffix);
+            }
+            catch(const std::exception& e)
+            {
+                stats.warnings.push_back("Failed to move plot data for \"" +
+                    path + "\": " + e.what());
+            }
+            record("move", start);
+        }
+    }
+    else
+    {
+        try
+        {
+            std::filesystem::remove_all(data);
+        }
+        catch(const std::exception& e)
+        {
+            stats.warnings.push_back("Failed to delete plot data for \"" +
+                path + "\": " + e.what());
+        }
+        record("delete", start);
+    }
+
+    if(!cacheKey.empty())
+    {
+        const auto storeStart = std::chrono::steady_clock::now();
+        try
+        {
+            cache_store(cacheDir, cacheKey, recipe->job, newPath, archived ?
+                zipPath : "", cacheSize);
+        }
+        catch(const std::exception& e)
+        {
+            stats.warnings.push_back("Failed to cache \"" + path + recipe->
+                extension + "\": " + e.what());
+        }
+        record("cache store", storeStart);
+    }
+    report_stats(path, stats, target);
+    return warning_lines(stats);
+}
+
+std::string pgfplotter::Build::output(bool deleteData) const
+{
+    if(format != OutputFormat::TeX)
+    {
+        return path + recipe->extension;
+    }
+    return archive && !deleteData ? path + Suffix + ".zip" : path + Suffix +
+        "/" + recipe->job + ".tex";
+}
+
+void pgfplotter::compile(const std::string& path, const std::string& src, const
+    PlotOptions& options, PlotStats stats, bool deleteData)
+{
+    Build build(path, src, options, std::move(stats));
+    if(!build.restore())
+    {
+        for(const auto& n : build.stages())
+        {
+            build.run(n);
+        }
+    }
+    const std::string warnings = build.finish(deleteData);
+
+    std::cout << "Plotted \"" << build.output(deleteData) << "\"" << std::endl;
+
+    print_warnings(warnings);
+}
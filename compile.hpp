@@ -0,0 +1,225 @@
+#ifndef PGFPLOTTER_COMPILE_HPP
+#define PGFPLOTTER_COMPILE_HPP
+
+#include "pgfplotter"
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+namespace pgfplotter
+{
+    // Appended to the plot path to name the directory holding the LuaLaTeX
+    // source and data files.
+    inline const std::string Suffix = "_plot_data";
+
+    // How a process ended, as in `PlotStats::StageTime`, and the CPU time
+    // used by it and the children it waited for.
+    struct ProcessResult
+    {
+        int exitCode = -1;
+        std::uint64_t peakMemory = 0;
+        double cpuSeconds = 0.;
+        // Signal that ended it, or zero if it exited.
+        int signal = 0;
+        // Whether it was killed for reaching `ProcessLimits::seconds`.
+        bool timedOut = false;
+    };
+
+    // Limits on a process, zero for none, only enforced on Unix. After
+    // `seconds` of wall time, the process and everything it started are
+    // killed. `cpuSeconds` and `memory` (bytes of address space) are
+    // resource limits of each process. With any limit, whatever the process
+    // leaves running when it exits is killed too. Without, it's left running,
+    // but not waited for.
+    struct ProcessLimits
+    {
+        double seconds = 0.;
+        double cpuSeconds = 0.;
+        std::uint64_t memory = 0;
+    };
+
+    // Run `file` with `args`, throwing if it cannot be run or does not exit
+    // with status zero. Standard output goes to `output` if given, and the
+    // end of anything else the process writes to the exception. If `result`
+    // is given, it's filled in once the process has ended, even if this
+    // throws.
+    void system_call(const std::string& file, const std::vector<std::string>&
+        args, std::string* output = nullptr, ProcessResult* result = nullptr,
+        const ProcessLimits& limits = {});
+
+    // Passes `stats` to the stats hook, if installed, then copies them to
+    // `target`, if not null. An exception from the hook is added to the
+    // warnings of `stats`.
+    void report_stats(const std::string& path, PlotStats& stats, PlotStats*
+        target);
+    // The warnings of `stats`, one per line.
+    std::string warning_lines(const PlotStats& stats);
+    // Prints each line of `warnings` as a warning.
+    void print_warnings(const std::string& warnings);
+
+    // Extract directories from path.
+    void split_path(const std::string& path, std::string& dir, std::string&
+        name);
+
+    // What the plot at `path` produces with `options`: its PNG, its PDF or,
+    // for `OutputFormat::TeX`, its data directory.
+    std::string output_name(const std::string& path, const PlotOptions&
+        options);
+
+    // Where the data directory of the plot at `path` is built, before
+    // `Suffix`: `path` itself, or a name unique to the absolute plot path in
+    // `PlotOptions::scratchDir`, which is created if need be.
+    std::string scratch_path(const std::string& path, const PlotOptions&
+        options);
+
+    // Create the directory holding the LuaLaTeX source and data files.
+    void create_data_dir(const std::string& path);
+
+    // First line of `lualatex --version`, queried once. Throws if LuaLaTeX
+    // can't be run.
+    const std::string& toolchain_version();
+
+    // Shared preamble of every plot source.
+    const std::string& preamble_src();
+
+    // Path, without extension, of a LuaLaTeX format with the preamble
+    // precompiled, built in `dir` (or the system temporary directory if
+    // empty) once per preamble and toolchain version. Empty if the format
+    // cannot be built, in which case the preamble is compiled as before and
+    // `warning` says why, and otherwise `warning` is cleared.
+    std::string preamble_format(const std::string& dir, std::string& warning);
+
+    // Directory of the render cache.
+    std::string cache_dir(const PlotOptions& options);
+    // Hash identifying the plot from its source and the data files in
+    // `dataDir` listed in `stats`, together with the options and toolchain
+    // version affecting the output. The same for any plot name.
+    std::string cache_key(const std::string& src, const std::string& dataDir,
+        const PlotStats& stats, const PlotOptions& options);
+    // Links or copies the cached PNG or PDF, by the extension of
+    // `outputPath`, to `outputPath`, counting a hit or miss. Returns false if
+    // there is none.
+    bool cache_restore(const std::string& dir, const std::string& key, const
+        std::string& outputPath);
+    // Links or copies the cached archive of the plot named `name` to
+    // `zipPath`, as the source in it is named after the plot. Returns false if
+    // there is none.
+    bool cache_restore_archive(const std::string& dir, const std::string& key,
+        const std::string& name, const std::string& zipPath);
+    // Adds the PNG or PDF and, if not empty, the archive to the cache unless
+    // already there. If that takes the cache over `maxSize` bytes, evicts
+    // the least recently used plots until it fits. The size is counted as
+    // plots are added, so the cache is only walked when it's full.
+    void cache_store(const std::string& dir, const std::string& key, const
+        std::string& name, const std::string& outputPath, const std::string&
+        zipPath, std::uintmax_t maxSize);
+
+    // One step of the external toolchain, run as a target of the generated
+    // Makefile.
+    struct Stage
+    {
+        std::string name;
+        std::string target;
+    };
+
+    // The toolchain stages turning the source "job.tex" in a data directory
+    // into the output format, and the Makefile running them. These only
+    // depend on `job` and the options, so plots can share them.
+    struct Recipe
+    {
+        std::string job;
+        std::vector<Stage> stages;
+        std::string makefile;
+        // File the last stage leaves in the data directory, and the extension
+        // it's moved into place with. Empty for `OutputFormat::TeX`.
+        std::string product;
+        std::string extension;
+
+        // Throws if `job` contains whitespace.
+        Recipe(const std::string& job, const PlotOptions& options);
+    };
+
+    // The LuaLaTeX source and Makefile of one plot, and the toolchain stages
+    // turning them into the output format.
+    class Build
+    {
+        std::string path;
+        std::string dir;
+        std::string name;
+        // Data directory, which is `path + Suffix` unless in the scratch
+        // directory.
+        std::string data;
+        std::shared_ptr<const Recipe> recipe;
+        OutputFormat format;
+        bool archive;
+        // Threads compressing the archive, as `PlotOptions::threads`.
+        unsigned int threads;
+        // Limits of each stage, with `PlotOptions::stageTimeout` as the time
+        // limit, and of all of them together.
+        ProcessLimits limits;
+        double timeout;
+        // Wall time of the stages run so far.
+        double toolchainSeconds = 0.;
+        // Precompiled preamble passed to `make` as `FMT`, empty if none.
+        std::string formatPath;
+        PlotStats stats;
+        // Where to copy `stats` once done, from `PlotOptions::stats`.
+        PlotStats* target;
+        // Empty unless the render cache is used.
+        std::string cacheKey;
+        std::string cacheDir;
+        std::uintmax_t cacheSize;
+        bool restored = false;
+
+        // Appends the time since `start` and how the stage's process ended, if
+        // it ran one, to `stats`.
+        void record(const std::string& stage, std::chrono::steady_clock::
+            time_point start, const ProcessResult& result = {});
+
+    public:
+        // Writes the source and Makefile to the data directory, which must
+        // already hold the data files, adding to the `stats` of generating
+        // them. Uses `recipe`, which must have been made with the same
+        // options, if not null, or otherwise one named after the plot.
+        Build(const std::string& path, const std::string& src, const
+            PlotOptions& options, PlotStats stats, std::shared_ptr<const
+            Recipe> recipe = nullptr);
+
+        const std::vector<Stage>& stages() const
+        {
+            return recipe->stages;
+        }
+
+        // Takes the output from the render cache, if enabled and it holds
+        // this plot, in which case the stages must not be run.
+        bool restore();
+        // Throws `PlotError`, or `LimitError` if it's over a limit, if the
+        // stage fails, in which case the statistics are reported. Either way,
+        // the time it took is recorded.
+        void run(const Stage& stage);
+        // Moves the output into place, throwing `PlotError` on failure, then
+        // archives, deletes or moves the data directory as `PlotOptions::
+        // archive` says, or always deletes it if `deleteData`, and adds the
+        // plot to the render cache, if enabled, and reports the statistics.
+        // Returns the warnings in the statistics, one per line, including
+        // those of anything that failed here.
+        std::string finish(bool deleteData);
+        // Where `finish` left the result.
+        std::string output(bool deleteData) const;
+    };
+
+    // Rasterizes `p` to `path.png` in process, for `PlotOptions::preview`.
+    // Returns the warnings, one per line.
+    std::string render_preview(const std::string& path, const std::vector<
+        const Axis*>& p, const PlotOptions& options);
+
+    // Write LuaLaTeX to a temporary file, compile and clean up, adding to the
+    // `stats` of generating `src`. Throws `PlotError` if the toolchain fails
+    // to produce the plot.
+    void compile(const std::string& path, const std::string& src, const
+        PlotOptions& options, PlotStats stats, bool deleteData);
+}
+
+#endif
@@ -0,0 +1,190 @@
+#include "contour.hpp"
+#include "parallel.hpp"
+#include <unordered_map>
+#include <array>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    constexpr std::size_t None = -1;
+
+    // Crossing edges are numbered 2*k for the edge from grid point `k` along
+    // x and 2*k + 1 for the one along y.
+    struct Segment
+    {
+        std::size_t edges[2];
+    };
+}
+
+// Marching squares over every cell of the grid at `level`.
+static std::vector<Segment> level_segments(const double* z, std::size_t numX,
+    std::size_t numY, double level)
+{
+    std::vector<Segment> segments;
+    for(std::size_t i = 0; i + 1 < numX; ++i)
+    {
+        for(std::size_t j = 0; j + 1 < numY; ++j)
+        {
+            // Corners in order around the cell.
+            const std::size_t k = i*numY + j;
+            const double corners[4] = {z[k], z[k + numY], z[k + numY + 1],
+                z[k + 1]};
+            // Most cells are entirely on one side.
+            const int numAbove = (corners[0] >= level) + (corners[1] >= level) +
+                (corners[2] >= level) + (corners[3] >= level);
+            if(numAbove == 0 || numAbove == 4)
+            {
+                continue;
+            }
+            if(!std::isfinite(corners[0]) || !std::isfinite(corners[1]) ||
+                !std::isfinite(corners[2]) || !std::isfinite(corners[3]))
+            {
+                continue;
+            }
+            // Edge `n` runs from corner `n` to corner `n + 1`.
+            const std::size_t edges[4] = {2*k, 2*(k + numY) + 1, 2*(k + 1),
+                2*k + 1};
+            bool above[4];
+            std::size_t crossed[4];
+            std::size_t numCrossed = 0;
+            for(int n = 0; n < 4; ++n)
+            {
+                above[n] = corners[n] >= level;
+            }
+            for(int n = 0; n < 4; ++n)
+            {
+                if(above[n] != above[(n + 1)%4])
+                {
+                    crossed[numCrossed++] = edges[n];
+                }
+            }
+            if(numCrossed == 2)
+            {
+                segments.push_back({{crossed[0], crossed[1]}});
+            }
+            else if(numCrossed == 4)
+            {
+                // Saddle: the center decides which opposite corners are
+                // joined, and the other two are cut off.
+                const bool center = (corners[0] + corners[1] + corners[2] +
+                    corners[3])/4. >= level;
+                if(center == above[0])
+                {
+                    segments.push_back({{edges[0], edges[1]}});
+                    segments.push_back({{edges[2], edges[3]}});
+                }
+                else
+                {
+                    segments.push_back({{edges[3], edges[0]}});
+                    segments.push_back({{edges[1], edges[2]}});
+                }
+            }
+        }
+    }
+    return segments;
+}
+
+// Joins `segments` into polylines through the level crossing of each edge.
+static void join_segments(const double* x, const double* y, const double* z,
+    std::size_t numY, double level, const std::vector<Segment>& segments, std::
+    vector<pgfplotter::ContourLine>& lines)
+{
+    // The at most two segments meeting at each edge.
+    std::unordered_map<std::size_t, std::array<std::size_t, 2>> ends;
+    for(std::size_t i = 0; i < segments.size(); ++i)
+    {
+        for(const std::size_t n : segments[i].edges)
+        {
+            auto& m = ends.try_emplace(n, std::array<std::size_t, 2>{None,
+                None}).first->second;
+            m[m[0] != None] = i;
+        }
+    }
+
+    std::vector<bool> used(segments.size());
+    auto walk = [&](std::size_t edge, std::size_t segment)
+    {
+        pgfplotter::ContourLine line{level, {}, {}};
+        auto add = [&](std::size_t n)
+        {
+            const std::size_t a = n/2;
+            const std::size_t b = a + (n%2 ? 1 : numY);
+            const double t = (level - z[a])/(z[b] - z[a]);
+            line.x.push_back(x[a] + t*(x[b] - x[a]));
+            line.y.push_back(y[a] + t*(y[b] - y[a]));
+        };
+        add(edge);
+        while(segment != None)
+        {
+            used[segment] = true;
+            const Segment& s = segments[segment];
+            edge = s.edges[s.edges[0] == edge];
+            add(edge);
+            const auto& m = ends[edge];
+            segment = m[0] == segment ? m[1] : m[0];
+            if(segment != None && used[segment])
+            {
+                segment = None;
+            }
+        }
+        lines.push_back(std::move(line));
+    };
+
+    // Open lines start at an edge with one segment, the rest are closed.
+    for(std::size_t i = 0; i < segments.size(); ++i)
+    {
+        for(const std::size_t n : segments[i].edges)
+        {
+            if(!used[i] && ends[n][1] == None)
+            {
+                walk(n, i);
+            }
+        }
+    }
+    for(std::size_t i = 0; i < segments.size(); ++i)
+    {
+        if(!used[i])
+        {
+            walk(segments[i].edges[0], i);
+        }
+    }
+}
+
+std::vector<pgfplotter::ContourLine> pgfplotter::contour_lines(const double* x,
+    const double* y, const double* z, std::size_t numX, std::size_t numY,
+    unsigned int numLevels)
+{
+    double zMin = std::numeric_limits<double>::infinity();
+    double zMax = -std::numeric_limits<double>::infinity();
+    for(std::size_t i = 0; i < numX*numY; ++i)
+    {
+        if(std::isfinite(z[i]))
+        {
+            zMin = std::min(zMin, z[i]);
+            zMax = std::max(zMax, z[i]);
+        }
+    }
+    if(!(zMin < zMax))
+    {
+        return {};
+    }
+
+    std::vector<std::vector<ContourLine>> levels(numLevels);
+    parallel_for(numLevels, [&](std::size_t i)
+    {
+        const double level = zMin + (i + 1)*(zMax - zMin)/(numLevels + 1);
+        join_segments(x, y, z, numY, level, level_segments(z, numX, numY,
+            level), levels[i]);
+    });
+
+    std::vector<ContourLine> lines;
+    for(auto& n : levels)
+    {
+        for(auto& m : n)
+        {
+            lines.push_back(std::move(m));
+        }
+    }
+    return lines;
+}
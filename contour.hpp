@@ -0,0 +1,28 @@
+#ifndef PGFPLOTTER_CONTOUR_HPP
+#define PGFPLOTTER_CONTOUR_HPP
+
+#include <vector>
+#include <cstddef>
+
+namespace pgfplotter
+{
+    // Polyline at height `level`. Closed lines repeat their first point.
+    struct ContourLine
+    {
+        double level;
+        std::vector<double> x;
+        std::vector<double> y;
+    };
+
+    // Contour lines of the `numX` by `numY` grid `(x, y, z)`, stored with y
+    // varying fastest, at `numLevels` heights evenly spaced strictly between
+    // the lowest and highest finite `z`. Found by marching squares, in
+    // parallel across levels, skipping cells with a non-finite corner. The
+    // segments are joined into polylines, in an order that only depends on
+    // the grid.
+    std::vector<ContourLine> contour_lines(const double* x, const double* y,
+        const double* z, std::size_t numX, std::size_t numY, unsigned int
+        numLevels);
+}
+
+#endif
@@ -0,0 +1,152 @@
+#include "decimate.hpp"
+#include "parallel.hpp"
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+// Appends the points of `[first, last)` to keep to `keep`.
+static void decimate_range(const double* x, const double* y, std::size_t
+    first, std::size_t last, double lo, double scale, bool log, std::vector<
+    std::size_t>& keep)
+{
+    std::size_t runStart = first;
+    double runColumn = 0.;
+    std::size_t runMin = first;
+    std::size_t runMax = first;
+
+    auto flush = [&](std::size_t runEnd)
+    {
+        if(runStart == runEnd)
+        {
+            return;
+        }
+        const std::size_t runLast = runEnd - 1;
+        std::size_t points[4] = {runStart, std::min(runMin, runMax), std::max(
+            runMin, runMax), runLast};
+        std::size_t* end = std::unique(points, points + 4);
+        keep.insert(keep.end(), points, end);
+    };
+
+    for(std::size_t i = first; i < last; ++i)
+    {
+        const double u = log ? std::log10(x[i]) : x[i];
+        if(!std::isfinite(u) || !std::isfinite(y[i]))
+        {
+            flush(i);
+            keep.push_back(i);
+            runStart = i + 1;
+            continue;
+        }
+        const double column = std::floor((u - lo)*scale);
+        if(i == runStart || column != runColumn)
+        {
+            flush(i);
+            runStart = i;
+            runColumn = column;
+            runMin = i;
+            runMax = i;
+        }
+        else if(y[i] < y[runMin])
+        {
+            runMin = i;
+        }
+        else if(y[i] > y[runMax])
+        {
+            runMax = i;
+        }
+    }
+    flush(last);
+}
+
+std::vector<std::size_t> pgfplotter::decimate_line(const double* x, const
+    double* y, std::size_t n, double lo, double hi, std::size_t columns, bool
+    log)
+{
+    if(log)
+    {
+        lo = std::log10(lo);
+        hi = std::log10(hi);
+    }
+    const double scale = hi > lo ? columns/(hi - lo) : 0.;
+
+    // Runs split at chunk boundaries only cost a few extra points.
+    constexpr std::size_t MinChunk = 1 << 16;
+    const std::size_t numChunks = std::max<std::size_t>(1, std::min<std::
+        size_t>(thread_budget(), n/MinChunk));
+    std::vector<std::vector<std::size_t>> chunks(numChunks);
+    parallel_for(numChunks, [&](std::size_t i)
+    {
+        decimate_range(x, y, n*i/numChunks, n*(i + 1)/numChunks, lo, scale,
+            log, chunks[i]);
+    });
+
+    std::size_t size = 0;
+    for(const auto& c : chunks)
+    {
+        size += c.size();
+    }
+    std::vector<std::size_t> keep;
+    keep.reserve(size);
+    for(const auto& c : chunks)
+    {
+        keep.insert(keep.end(), c.begin(), c.end());
+    }
+    return keep;
+}
+
+std::size_t pgfplotter::decimate_grid(const double* x, const double* y, const
+    double* z, std::size_t numX, std::size_t numY, std::size_t maxX, std::
+    size_t maxY, Pooling pooling, std::array<std::vector<double>, 3>& out)
+{
+    const std::size_t blockX = maxX && numX > maxX ? (numX + maxX - 1)/maxX :
+        1;
+    const std::size_t blockY = maxY && numY > maxY ? (numY + maxY - 1)/maxY :
+        1;
+    const std::size_t outX = (numX + blockX - 1)/blockX;
+    const std::size_t outY = (numY + blockY - 1)/blockY;
+    for(auto& n : out)
+    {
+        n.resize(outX*outY);
+    }
+
+    constexpr double NaN = std::numeric_limits<double>::quiet_NaN();
+    parallel_for(outX, [&](std::size_t i)
+    {
+        const std::size_t lastX = std::min(numX, (i + 1)*blockX);
+        for(std::size_t j = 0; j < outY; ++j)
+        {
+            const std::size_t lastY = std::min(numY, (j + 1)*blockY);
+            double sumX = 0.;
+            double sumY = 0.;
+            std::size_t numXY = 0;
+            double sumZ = 0.;
+            double maxZ = -std::numeric_limits<double>::infinity();
+            std::size_t numZ = 0;
+            for(std::size_t k = i*blockX; k < lastX; ++k)
+            {
+                for(std::size_t l = j*blockY; l < lastY; ++l)
+                {
+                    const std::size_t m = k*numY + l;
+                    if(std::isfinite(x[m]) && std::isfinite(y[m]))
+                    {
+                        sumX += x[m];
+                        sumY += y[m];
+                        ++numXY;
+                    }
+                    if(std::isfinite(z[m]))
+                    {
+                        sumZ += z[m];
+                        maxZ = std::max(maxZ, z[m]);
+                        ++numZ;
+                    }
+                }
+            }
+            const std::size_t m = i*outY + j;
+            out[0][m] = numXY ? sumX/numXY : NaN;
+            out[1][m] = numXY ? sumY/numXY : NaN;
+            out[2][m] = !numZ ? NaN : pooling == Pooling::Max ? maxZ : sumZ/
+                numZ;
+        }
+    });
+    return outY;
+}
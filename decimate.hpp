@@ -0,0 +1,34 @@
+#ifndef PGFPLOTTER_DECIMATE_HPP
+#define PGFPLOTTER_DECIMATE_HPP
+
+#include "pgfplotter"
+#include <vector>
+#include <array>
+#include <cstddef>
+
+namespace pgfplotter
+{
+    // Width of `\textwidth` in the standalone document class, in inches.
+    inline constexpr double TextWidth = 345./72.27;
+    // Default size of a grid cell in pixels when downsampling surfaces.
+    inline constexpr double GridCellPixels = 4.;
+
+    // Indices, in order, of the points of the polyline `(x, y)` needed to draw
+    // it the same at `columns` pixel columns across `[lo, hi]` (in log space
+    // if `log`): the first, last, lowest and highest point of each run of
+    // consecutive points falling in the same column. Points with non-finite
+    // coordinates are always kept. Runs in parallel for long lines.
+    std::vector<std::size_t> decimate_line(const double* x, const double* y,
+        std::size_t n, double lo, double hi, std::size_t columns, bool log);
+
+    // Pools blocks of the `numX` by `numY` grid `(x, y, z)`, stored with y
+    // varying fastest, into `out` so it has at most `maxX` by `maxY` points.
+    // Coordinates are averaged and `z` pooled as given, ignoring non-finite
+    // values. A zero limit leaves that direction alone. Returns the new
+    // number of y values.
+    std::size_t decimate_grid(const double* x, const double* y, const double*
+        z, std::size_t numX, std::size_t numY, std::size_t maxX, std::size_t
+        maxY, Pooling pooling, std::array<std::vector<double>, 3>& out);
+}
+
+#endif
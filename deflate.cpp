@@ -0,0 +1,609 @@
+#include "deflate.hpp"
+#include <array>
+#include <cstring>
+#include <algorithm>
+#include <queue>
+#include <functional>
+
+namespace
+{
+    constexpr std::size_t WindowSize = 1 << 15;
+    constexpr std::size_t HashSize = 1 << 15;
+    constexpr std::size_t MinMatch = 3;
+    constexpr std::size_t MaxMatch = 258;
+    // A match long enough to stop searching at.
+    constexpr std::size_t GoodMatch = 64;
+    // Longest match whose positions are all added to the hash chains; longer
+    // ones are mostly runs and only their start is.
+    constexpr std::size_t MaxInsert = 32;
+    // Input per block, below the limit of a stored block.
+    constexpr std::size_t BlockSize = (1 << 16) - 1 - MaxMatch;
+
+    constexpr std::array<std::uint16_t, 29> LengthBase = {3, 4, 5, 6, 7, 8, 9,
+        10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115,
+        131, 163, 195, 227, 258};
+    constexpr std::array<unsigned char, 29> LengthExtra = {0, 0, 0, 0, 0, 0, 0,
+        0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    constexpr std::array<std::uint16_t, 30> DistanceBase = {1, 2, 3, 4, 5, 7, 9,
+        13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537,
+        2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    constexpr std::array<unsigned char, 30> DistanceExtra = {0, 0, 0, 0, 1, 1,
+        2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12,
+        13, 13};
+
+    // Length of the common prefix of `a` and `b`, up to `n`, compared a word
+    // at a time.
+    std::size_t common_length(const unsigned char* a, const unsigned char* b,
+        std::size_t n)
+    {
+        std::size_t i = 0;
+        for(; i + 8 <= n; i += 8)
+        {
+            std::uint64_t x, y;
+            std::memcpy(&x, a + i, 8);
+            std::memcpy(&y, b + i, 8);
+            if(x != y)
+            {
+                break;
+            }
+        }
+        while(i < n && a[i] == b[i])
+        {
+            ++i;
+        }
+        return i;
+    }
+
+    // Fixed Huffman code of a literal/length symbol, bit-reversed for output.
+    struct Code
+    {
+        std::uint16_t bits;
+        unsigned char length;
+    };
+
+    std::uint32_t reverse(std::uint32_t code, unsigned int n)
+    {
+        std::uint32_t r = 0;
+        for(unsigned int i = 0; i < n; ++i)
+        {
+            r = (r << 1) | ((code >> i) & 1);
+        }
+        return r;
+    }
+
+    const std::array<Code, 288> FixedCodes = []()
+    {
+        std::array<Code, 288> codes;
+        for(std::uint32_t i = 0; i < 288; ++i)
+        {
+            const std::uint32_t code = i < 144 ? 0x30 + i : i < 256 ? 0x190 + i
+                - 144 : i < 280 ? i - 256 : 0xc0 + i - 280;
+            const unsigned char n = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+            codes[i] = {static_cast<std::uint16_t>(reverse(code, n)), n};
+        }
+        return codes;
+    }();
+
+    const std::array<std::uint32_t, 256> CrcTable = []()
+    {
+        std::array<std::uint32_t, 256> table;
+        for(std::uint32_t i = 0; i < 256; ++i)
+        {
+            std::uint32_t c = i;
+            for(int j = 0; j < 8; ++j)
+            {
+                c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        return table;
+    }();
+
+    // Huffman code for symbols with the given frequencies, at most `limit`
+    // bits long, with canonical codes bit-reversed for output.
+    struct HuffmanCode
+    {
+        std::vector<unsigned char> lengths;
+        std::vector<std::uint16_t> codes;
+
+        HuffmanCode(std::vector<std::uint32_t> freqs, unsigned int limit) :
+            lengths(freqs.size()), codes(freqs.size())
+        {
+            const std::size_t n = freqs.size();
+            while(true)
+            {
+                using Node = std::pair<std::uint64_t, std::size_t>;
+                std::priority_queue<Node, std::vector<Node>, std::greater<
+                    Node>> heap;
+                for(std::size_t i = 0; i < n; ++i)
+                {
+                    if(freqs[i])
+                    {
+                        heap.push({freqs[i], i});
+                    }
+                }
+                if(heap.size() == 1)
+                {
+                    lengths[heap.top().second] = 1;
+                }
+                if(heap.size() <= 1)
+                {
+                    break;
+                }
+
+                // Internal nodes are numbered from `n` up, so each one's
+                // parent comes after it.
+                std::vector<std::size_t> parent(2*n);
+                std::size_t next = n;
+                while(heap.size() > 1)
+                {
+                    const Node a = heap.top();
+                    heap.pop();
+                    const Node b = heap.top();
+                    heap.pop();
+                    parent[a.second] = next;
+                    parent[b.second] = next;
+                    heap.push({a.first + b.first, next++});
+                }
+                std::vector<unsigned int> depth(next);
+                for(std::size_t i = next - 1; i-- > n;)
+                {
+                    depth[i] = depth[parent[i]] + 1;
+                }
+                unsigned int maxLength = 0;
+                for(std::size_t i = 0; i < n; ++i)
+                {
+                    lengths[i] = freqs[i] ? depth[parent[i]] + 1 : 0;
+                    maxLength = std::max<unsigned int>(maxLength, lengths[i]);
+                }
+                if(maxLength <= limit)
+                {
+                    break;
+                }
+                // Flattens the distribution until the code fits.
+                for(auto& f : freqs)
+                {
+                    f = f ? (f >> 1) | 1 : 0;
+                }
+            }
+
+            std::uint32_t count[16] = {};
+            for(const auto l : lengths)
+            {
+                ++count[l];
+            }
+            count[0] = 0;
+            std::uint32_t nextCode[16] = {};
+            for(unsigned int l = 1, code = 0; l < 16; ++l)
+            {
+                code = (code + count[l - 1]) << 1;
+                nextCode[l] = code;
+            }
+            for(std::size_t i = 0; i < n; ++i)
+            {
+                if(lengths[i])
+                {
+                    codes[i] = static_cast<std::uint16_t>(reverse(nextCode[
+                        lengths[i]]++, lengths[i]));
+                }
+            }
+        }
+    };
+
+    // Order the lengths of the code length code are sent in.
+    constexpr std::array<unsigned char, 19> CodeLengthOrder = {16, 17, 18, 0,
+        8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+    // Symbols of every match length, and of distances up to 256 and of the
+    // rest divided by 128, which share symbols in the same groups.
+    const std::array<unsigned char, MaxMatch + 1> LengthSymbols = []()
+    {
+        std::array<unsigned char, MaxMatch + 1> symbols = {};
+        for(std::size_t l = MinMatch; l <= MaxMatch; ++l)
+        {
+            symbols[l] = static_cast<unsigned char>(std::upper_bound(LengthBase.
+                begin(), LengthBase.end(), l) - LengthBase.begin() - 1);
+        }
+        return symbols;
+    }();
+    const std::array<unsigned char, 512> DistanceSymbols = []()
+    {
+        std::array<unsigned char, 512> symbols = {};
+        for(std::size_t i = 0; i < 512; ++i)
+        {
+            const std::size_t d = i < 256 ? i + 1 : ((i - 256) << 7) + 1;
+            symbols[i] = static_cast<unsigned char>(std::upper_bound(
+                DistanceBase.begin(), DistanceBase.end(), d) - DistanceBase.
+                begin() - 1);
+        }
+        return symbols;
+    }();
+
+    std::size_t length_symbol(std::size_t length)
+    {
+        return LengthSymbols[length];
+    }
+
+    std::size_t distance_symbol(std::size_t distance)
+    {
+        return DistanceSymbols[distance <= 256 ? distance - 1 : 256 + ((
+            distance - 1) >> 7)];
+    }
+}
+
+std::uint32_t pgfplotter::crc32(const void* data, std::size_t size, std::
+    uint32_t crc)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for(std::size_t i = 0; i < size; ++i)
+    {
+        crc = CrcTable[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+pgfplotter::Deflate::Deflate(unsigned int maxChain) : head(HashSize, -1),
+    prev(WindowSize, -1), maxChain(maxChain) {}
+
+void pgfplotter::Deflate::put(std::uint32_t value, unsigned int n, std::string&
+    out)
+{
+    bits |= static_cast<std::uint64_t>(value) << numBits;
+    numBits += n;
+    // Codes are at most 16 bits, so this leaves room for the next.
+    if(numBits >= 32)
+    {
+        const char bytes[] = {static_cast<char>(bits), static_cast<char>(
+            bits >> 8), static_cast<char>(bits >> 16), static_cast<char>(bits >>
+            24)};
+        out.append(bytes, 4);
+        bits >>= 32;
+        numBits -= 32;
+    }
+}
+
+void pgfplotter::Deflate::flush(std::string& out)
+{
+    put(0, (8 - numBits%8)%8, out);
+    for(; numBits; numBits -= 8)
+    {
+        out += static_cast<char>(bits & 0xff);
+        bits >>= 8;
+    }
+}
+
+void pgfplotter::Deflate::insert(std::size_t p)
+{
+    const std::size_t h = ((buffer[p] << 10) ^ (buffer[p + 1] << 5) ^ buffer[p +
+        2]) & (HashSize - 1);
+    prev[p & (WindowSize - 1)] = head[h];
+    head[h] = static_cast<std::int32_t>(p);
+}
+
+void pgfplotter::Deflate::match(std::size_t lookahead, std::string& out)
+{
+    while(pos + lookahead < buffer.size())
+    {
+        std::size_t bestLength = 0;
+        std::size_t bestDistance = 0;
+        if(pos + MinMatch <= buffer.size())
+        {
+            const std::size_t maxLength = std::min(MaxMatch, buffer.size() -
+                pos);
+            const std::size_t h = ((buffer[pos] << 10) ^ (buffer[pos + 1] << 5)
+                ^ buffer[pos + 2]) & (HashSize - 1);
+            std::int32_t candidate = head[h];
+            for(unsigned int chain = maxChain; candidate >= 0 && chain; --chain)
+            {
+                const std::size_t c = candidate;
+                if(pos - c > WindowSize)
+                {
+                    break;
+                }
+                if(buffer[c + bestLength] == buffer[pos + bestLength])
+                {
+                    const std::size_t n = common_length(&buffer[c], &buffer[
+                        pos], maxLength);
+                    if(n > bestLength)
+                    {
+                        bestLength = n;
+                        bestDistance = pos - c;
+                        if(n >= GoodMatch || n == maxLength)
+                        {
+                            break;
+                        }
+                    }
+                }
+                // Stale entries from an earlier pass over the window point
+                // forwards.
+                const std::int32_t next = prev[c & (WindowSize - 1)];
+                candidate = next < candidate ? next : -1;
+            }
+        }
+
+        if(bestLength >= MinMatch)
+        {
+            symbols.push_back({static_cast<std::uint16_t>(bestLength),
+                static_cast<std::uint16_t>(bestDistance)});
+        }
+        else
+        {
+            bestLength = 1;
+            symbols.push_back({buffer[pos], 0});
+        }
+        const std::size_t numInserts = bestLength > MaxInsert ? 1 :
+            bestLength;
+        for(std::size_t i = 0; i < numInserts; ++i)
+        {
+            if(pos + i + MinMatch <= buffer.size())
+            {
+                insert(pos + i);
+            }
+        }
+        pos += bestLength;
+
+        if(pos - blockStart >= BlockSize)
+        {
+            emit_block(false, out);
+        }
+    }
+}
+
+void pgfplotter::Deflate::emit_block(bool final, std::string& out)
+{
+    std::vector<std::uint32_t> litFreqs(286);
+    std::vector<std::uint32_t> distFreqs(30);
+    std::size_t extraBits = 0;
+    litFreqs[256] = 1;
+    for(const auto& n : symbols)
+    {
+        if(!n.distance)
+        {
+            ++litFreqs[n.length];
+            continue;
+        }
+        const std::size_t l = length_symbol(n.length);
+        const std::size_t d = distance_symbol(n.distance);
+        ++litFreqs[257 + l];
+        ++distFreqs[d];
+        extraBits += LengthExtra[l] + DistanceExtra[d];
+    }
+
+    // Size of the block in bits with the fixed codes and with codes fitted
+    // to it, which also have to be sent.
+    std::size_t fixedSize = 3 + extraBits;
+    for(std::size_t i = 0; i < litFreqs.size(); ++i)
+    {
+        fixedSize += litFreqs[i]*FixedCodes[i].length;
+    }
+    for(const auto n : distFreqs)
+    {
+        fixedSize += n*5;
+    }
+
+    const HuffmanCode lit(litFreqs, 15);
+    HuffmanCode dist(distFreqs, 15);
+    std::size_t numLit = 286;
+    std::size_t numDist = 30;
+    for(; numLit > 257 && !lit.lengths[numLit - 1]; --numLit);
+    for(; numDist > 1 && !dist.lengths[numDist - 1]; --numDist);
+    // At least one distance code has to be sent.
+    if(!dist.lengths[0] && numDist == 1)
+    {
+        dist.lengths[0] = 1;
+    }
+    // Code lengths run-length coded as symbols 0 to 18 and extra bits.
+    std::vector<unsigned char> lengths(lit.lengths.begin(), lit.lengths.begin()
+        + numLit);
+    lengths.insert(lengths.end(), dist.lengths.begin(), dist.lengths.begin() +
+        numDist);
+    std::vector<std::array<unsigned char, 2>> runs;
+    std::vector<std::uint32_t> runFreqs(19);
+    for(std::size_t i = 0; i < lengths.size();)
+    {
+        std::size_t n = 1;
+        while(i + n < lengths.size() && lengths[i + n] == lengths[i])
+        {
+            ++n;
+        }
+        n = std::min<std::size_t>(n, lengths[i] ? 7 : 138);
+        if(!lengths[i] && n >= 11)
+        {
+            runs.push_back({18, static_cast<unsigned char>(n - 11)});
+        }
+        else if(!lengths[i] && n >= 3)
+        {
+            runs.push_back({17, static_cast<unsigned char>(n - 3)});
+        }
+        else if(lengths[i] && n >= 4)
+        {
+            // The length itself, then a repeat of the previous one.
+            runs.push_back({lengths[i], 0});
+            runs.push_back({16, static_cast<unsigned char>(n - 4)});
+        }
+        else
+        {
+            n = 1;
+            runs.push_back({lengths[i], 0});
+        }
+        for(std::size_t j = runs.size() - 1 - (runs.back()[0] == 16); j < runs.
+            size(); ++j)
+        {
+            ++runFreqs[runs[j][0]];
+        }
+        i += n;
+    }
+    const HuffmanCode run(runFreqs, 7);
+    std::size_t numRun = 19;
+    for(; numRun > 4 && !run.lengths[CodeLengthOrder[numRun - 1]]; --numRun);
+
+    std::size_t dynamicSize = 3 + 14 + 3*numRun + extraBits;
+    for(const auto& n : runs)
+    {
+        dynamicSize += run.lengths[n[0]] + (n[0] == 16 ? 2 : n[0] == 17 ? 3 :
+            n[0] == 18 ? 7 : 0);
+    }
+    for(std::size_t i = 0; i < litFreqs.size(); ++i)
+    {
+        dynamicSize += litFreqs[i]*lit.lengths[i];
+    }
+    for(std::size_t i = 0; i < distFreqs.size(); ++i)
+    {
+        dynamicSize += distFreqs[i]*dist.lengths[i];
+    }
+
+    const std::size_t size = pos - blockStart;
+    if(std::min(fixedSize, dynamicSize) > (size + 5)*8)
+    {
+        put(final, 3, out);
+        flush(out);
+        put(size & 0xffff, 16, out);
+        put(~size & 0xffff, 16, out);
+        flush(out);
+        out.append(reinterpret_cast<const char*>(buffer.data() + blockStart),
+            size);
+    }
+    else
+    {
+        const bool fixed = fixedSize <= dynamicSize;
+        std::array<std::uint16_t, 286> litCodes;
+        std::array<unsigned char, 286> litLengths;
+        std::array<std::uint16_t, 30> distCodes;
+        std::array<unsigned char, 30> distLengths;
+        for(std::size_t i = 0; i < 286; ++i)
+        {
+            litCodes[i] = fixed ? FixedCodes[i].bits : lit.codes[i];
+            litLengths[i] = fixed ? FixedCodes[i].length : lit.lengths[i];
+        }
+        for(std::size_t i = 0; i < 30; ++i)
+        {
+            distCodes[i] = fixed ? static_cast<std::uint16_t>(reverse(i, 5)) :
+                dist.codes[i];
+            distLengths[i] = fixed ? 5 : dist.lengths[i];
+        }
+        if(fixed)
+        {
+            put(final | 2, 3, out);
+        }
+        else
+        {
+            put(final | 4, 3, out);
+            put(numLit - 257, 5, out);
+            put(numDist - 1, 5, out);
+            put(numRun - 4, 4, out);
+            for(std::size_t i = 0; i < numRun; ++i)
+            {
+                put(run.lengths[CodeLengthOrder[i]], 3, out);
+            }
+            for(const auto& n : runs)
+            {
+                put(run.codes[n[0]], run.lengths[n[0]], out);
+                if(n[0] >= 16)
+                {
+                    put(n[1], n[0] == 16 ? 2 : n[0] == 17 ? 3 : 7, out);
+                }
+            }
+        }
+        for(const auto& n : symbols)
+        {
+            if(!n.distance)
+            {
+                put(litCodes[n.length], litLengths[n.length], out);
+                continue;
+            }
+            const std::size_t l = length_symbol(n.length);
+            put(litCodes[257 + l], litLengths[257 + l], out);
+            put(n.length - LengthBase[l], LengthExtra[l], out);
+            const std::size_t d = distance_symbol(n.distance);
+            put(distCodes[d], distLengths[d], out);
+            put(n.distance - DistanceBase[d], DistanceExtra[d], out);
+        }
+        put(litCodes[256], litLengths[256], out);
+    }
+    symbols.clear();
+    blockStart = pos;
+
+    // Drop input that's left the window once it takes up most of the buffer.
+    if(blockStart >= 4*WindowSize)
+    {
+        // A multiple of the window, so `prev` stays indexed by position.
+        const std::size_t shift = (blockStart - WindowSize) & ~(WindowSize -
+            1);
+        buffer.erase(buffer.begin(), buffer.begin() + shift);
+        pos -= shift;
+        blockStart -= shift;
+        for(auto* n : {&head, &prev})
+        {
+            for(auto& m : *n)
+            {
+                m = m >= static_cast<std::int32_t>(shift) ? m - static_cast<
+                    std::int32_t>(shift) : -1;
+            }
+        }
+    }
+}
+
+void pgfplotter::Deflate::update(const void* data, std::size_t size, std::
+    string& out)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    // A window at a time, so the buffer stays small and cheap to slide.
+    for(std::size_t i = 0; i < size; i += WindowSize)
+    {
+        buffer.insert(buffer.end(), p + i, p + std::min(size, i + WindowSize));
+        // Keeps a full match of lookahead until the end of the input is
+        // known.
+        match(MaxMatch, out);
+    }
+}
+
+void pgfplotter::Deflate::sync(std::string& out)
+{
+    match(0, out);
+    emit_block(false, out);
+    put(0, 3, out);
+    flush(out);
+    put(0, 16, out);
+    put(0xffff, 16, out);
+    flush(out);
+}
+
+void pgfplotter::Deflate::finish(std::string& out)
+{
+    match(0, out);
+    emit_block(true, out);
+    flush(out);
+}
+
+std::string pgfplotter::zlib_compress(const void* data, std::size_t size,
+    unsigned int maxChain)
+{
+    std::string out = "\x78\x9c";
+    Deflate deflate(maxChain);
+    deflate.update(data, size, out);
+    deflate.finish(out);
+
+    // Adler-32 of the input, most significant byte first.
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    std::uint32_t a = 1;
+    std::uint32_t b = 0;
+    for(std::size_t i = 0; i < size;)
+    {
+        // Sums can't overflow within this many bytes.
+        const std::size_t end = std::min(size, i + 5552);
+        for(; i < end; ++i)
+        {
+            a += p[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    const std::uint32_t adler = (b << 16) | a;
+    for(int i = 24; i >= 0; i -= 8)
+    {
+        out += static_cast<char>((adler >> i) & 0xff);
+    }
+    return out;
+}
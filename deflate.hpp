@@ -0,0 +1,71 @@
+#ifndef PGFPLOTTER_DEFLATE_HPP
+#define PGFPLOTTER_DEFLATE_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace pgfplotter
+{
+    // CRC-32 as used by zip and PNG, continuing from `crc`.
+    std::uint32_t crc32(const void* data, std::size_t size, std::uint32_t crc =
+        0);
+
+    // Incremental raw deflate (RFC 1951) compressor, matching repeated
+    // strings with hash chains and coding each block with whichever of the
+    // fixed, dynamic or no Huffman codes is smallest.
+    class Deflate
+    {
+        // Uncompressed input, from up to a window before `blockStart` to the
+        // end of the input so far.
+        std::vector<unsigned char> buffer;
+        // Next position of `buffer` to match, and start of the current block.
+        std::size_t pos = 0;
+        std::size_t blockStart = 0;
+        // Last position of `buffer` with each hash of three bytes, and the
+        // previous position with the same hash for each position in the
+        // window.
+        std::vector<std::int32_t> head;
+        std::vector<std::int32_t> prev;
+        // Literals (`distance` zero) and matches of the current block.
+        struct Symbol
+        {
+            std::uint16_t length;
+            std::uint16_t distance;
+        };
+        std::vector<Symbol> symbols;
+        // Candidates tried per position.
+        unsigned int maxChain;
+        std::uint64_t bits = 0;
+        unsigned int numBits = 0;
+
+        void put(std::uint32_t value, unsigned int n, std::string& out);
+        // Pads the output to a whole byte and writes out all of it.
+        void flush(std::string& out);
+        void insert(std::size_t p);
+        // Matches all but the last `lookahead` bytes of input, emitting full
+        // blocks.
+        void match(std::size_t lookahead, std::string& out);
+        void emit_block(bool final, std::string& out);
+
+    public:
+        // Shorter chains trade compression for speed.
+        explicit Deflate(unsigned int maxChain = 32);
+
+        // Compresses `size` more bytes, appending the output completed so far
+        // to `out`.
+        void update(const void* data, std::size_t size, std::string& out);
+        // Appends the output so far to `out`, ending on a byte boundary with
+        // an empty stored block. Output of another compressor can follow it
+        // as part of the same stream.
+        void sync(std::string& out);
+        // Ends the stream, appending the rest of the output to `out`.
+        void finish(std::string& out);
+    };
+
+    // `data` compressed in the zlib format (RFC 1950).
+    std::string zlib_compress(const void* data, std::size_t size, unsigned int
+        maxChain = 32);
+}
+
+#endif
@@ -0,0 +1,146 @@
+#include "compile.hpp"
+#include "hash.hpp"
+#include <fstream>
+#include <filesystem>
+#include <mutex>
+#include <map>
+#include <random>
+#include <chrono>
+#include <algorithm>
+
+// How long a failed build is remembered before it's tried again.
+static constexpr std::chrono::hours RetryAfter(24);
+
+// Compiled with the precompiled format to check that it is usable.
+static const std::string TestBody = "\\begin{document}\n"
+    "\\begin{tikzpicture}\n"
+    "\\begin{axis}\n"
+    "\\addplot coordinates {(0, 0) (1, 1)};\n"
+    "\\end{axis}\n"
+    "\\end{tikzpicture}\n"
+    "\\end{document}\n";
+
+// Keeps a multiline error to the one line of a warning.
+static std::string one_line(std::string s)
+{
+    while(!s.empty() && s.back() == '\n')
+    {
+        s.pop_back();
+    }
+    std::replace(s.begin(), s.end(), '\n', ' ');
+    return s;
+}
+
+static void write_file(const std::string& path, const std::string& s)
+{
+    std::ofstream out(path);
+    if(!out)
+    {
+        throw std::runtime_error("Unable to open output file \"" + path +
+            "\".");
+    }
+    out << s;
+}
+
+// Dumps the preamble with `mylatexformat`, which makes LuaLaTeX skip the
+// preamble of any document compiled with the format, so documents are the
+// same with and without it. Returns the format path without extension.
+static std::string build_format(const std::string& dir, const std::string& name)
+{
+    const std::string tmp = dir + "/" + name + ".tmp" + std::to_string(std::
+        random_device()());
+    std::filesystem::remove_all(tmp);
+    std::filesystem::create_directories(tmp);
+    try
+    {
+        write_file(tmp + "/preamble.tex", pgfplotter::preamble_src() + "\\begi"
+            "n{document}\n\\end{document}\n");
+        pgfplotter::system_call("lualatex", {"-ini", "-jobname=" + name, "-out"
+            "put-directory=" + tmp, "-interaction=batchmode", "-halt-on-error",
+            "&lualatex", "mylatexformat.ltx", tmp + "/preamble.tex"});
+        write_file(tmp + "/test.tex", pgfplotter::preamble_src() + TestBody);
+        pgfplotter::system_call("lualatex", {"-fmt=" + tmp + "/" + name, "-out"
+            "put-directory=" + tmp, "-interaction=batchmode", "-halt-on-error",
+            tmp + "/test.tex"});
+        // Renaming is atomic, so concurrent builds never see a partial file.
+        std::filesystem::rename(tmp + "/" + name + ".fmt", dir + "/" + name +
+            ".fmt");
+    }
+    catch(...)
+    {
+        std::filesystem::remove_all(tmp);
+        throw;
+    }
+    std::filesystem::remove_all(tmp);
+    return dir + "/" + name;
+}
+
+std::string pgfplotter::preamble_format(const std::string& dir, std::string&
+    warning)
+{
+    static std::mutex mutex;
+    // The format and warning of each directory.
+    static std::map<std::string, std::pair<std::string, std::string>> formats;
+
+    const std::string cacheDir = dir.empty() ? (std::filesystem::
+        temp_directory_path()/"pgfplotter").string() : dir;
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto it = formats.find(cacheDir);
+    if(it != formats.end())
+    {
+        warning = it->second.second;
+        return it->second.first;
+    }
+
+    std::string format;
+    warning.clear();
+    try
+    {
+        if(cacheDir.find('"') != std::string::npos)
+        {
+            throw std::runtime_error("Format directory cannot contain double qu"
+                "ote character.");
+        }
+        Hash hash;
+        hash.field(toolchain_version());
+        hash.field(preamble_src());
+        const std::string name = "pgfplotter-" + hash.hex().substr(0, 16);
+        const std::string base = cacheDir + "/" + name;
+        std::filesystem::create_directories(cacheDir);
+        const std::string failed = base + ".failed";
+        if(std::filesystem::exists(base + ".fmt"))
+        {
+            format = base;
+        }
+        else if(std::filesystem::exists(failed) && std::filesystem::
+            file_time_type::clock::now() - std::filesystem::last_write_time(
+            failed) < RetryAfter)
+        {
+            std::ifstream in(failed);
+            std::string reason;
+            std::getline(in, reason);
+            warning = "Preamble not precompiled, as building the format failed "
+                "recently (delete \"" + failed + "\" to retry now): " + reason;
+        }
+        else
+        {
+            try
+            {
+                format = build_format(cacheDir, name);
+                std::filesystem::remove(failed);
+            }
+            catch(const std::exception& e)
+            {
+                // Not retried by other processes for a while.
+                write_file(failed, one_line(e.what()) + "\n");
+                throw;
+            }
+        }
+    }
+    catch(const std::exception& e)
+    {
+        warning = "Preamble not precompiled: " + one_line(e.what());
+    }
+    formats[cacheDir] = {format, warning};
+    return format;
+}
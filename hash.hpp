@@ -0,0 +1,41 @@
+#ifndef PGFPLOTTER_HASH_HPP
+#define PGFPLOTTER_HASH_HPP
+
+#include <string>
+#include <array>
+#include <cstdint>
+
+namespace pgfplotter
+{
+    // Incremental SHA-256, used to name cached formats and plots by their
+    // contents.
+    class Hash
+    {
+        std::array<std::uint32_t, 8> state;
+        std::array<unsigned char, 64> block;
+        std::size_t blockSize = 0;
+        std::uint64_t length = 0;
+
+        void compress(const unsigned char* p);
+
+    public:
+        Hash();
+
+        void update(const void* data, std::size_t size);
+        void update(const std::string& s)
+        {
+            update(s.data(), s.size());
+        }
+        // Hashes the size of `s` before `s`, so consecutive strings can't run
+        // into each other.
+        void field(const std::string& s);
+        // Hashes the contents of the file at `path`, throwing if it can't be
+        // read.
+        void file(const std::string& path);
+
+        // Lowercase hexadecimal digest. The hash can't be updated afterwards.
+        std::string hex();
+    };
+}
+
+#endif
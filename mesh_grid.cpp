@@ -1,46 +1,217 @@
 #include "pgfplotter"
+#include "parallel.hpp"
+#include <algorithm>
+#include <cmath>
+
+void pgfplotter::parallel_blocks(std::size_t n, const std::function<void(std::
+    size_t, std::size_t)>& f)
+{
+    // A few blocks per thread, so uneven rows still balance.
+    const std::size_t numBlocks = std::min<std::size_t>(n, 4*thread_budget());
+    parallel_for(numBlocks, [&](std::size_t i)
+    {
+        f(n*i/numBlocks, n*(i + 1)/numBlocks);
+    });
+}
 
 std::array<std::vector<double>, 3> pgfplotter::mesh_grid(const std::function<
     double(double, double)>& f, double xMin, double xMax, double yMin, double
     yMax, std::size_t res)
 {
-    return mesh_grid(f, xMin, xMax, yMin, yMax, res, res);
+    return mesh_grid<const std::function<double(double, double)>&>(f, xMin,
+        xMax, yMin, yMax, res, res);
 }
 
 std::array<std::vector<double>, 3> pgfplotter::mesh_grid(const std::function<
     double(double, double)>& f, double xMin, double xMax, double yMin, double
     yMax, std::size_t xRes, std::size_t yRes)
 {
-    if(!yRes)
+    return mesh_grid<const std::function<double(double, double)>&>(f, xMin,
+        xMax, yMin, yMax, xRes, yRes);
+}
+
+// Inserts the midpoint of every interval of `v` marked in `split`. Sets
+// `old[i]` to the index in `v` of the new `i`th value, or `-1` for
+// midpoints.
+static std::vector<double> refine(const std::vector<double>& v, const std::
+    vector<bool>& split, std::vector<std::ptrdiff_t>& old)
+{
+    std::vector<double> refined;
+    old.clear();
+    for(std::size_t i = 0; i < v.size(); ++i)
     {
-        yRes = xRes;
+        refined.push_back(v[i]);
+        old.push_back(i);
+        if(i + 1 < v.size() && split[i])
+        {
+            refined.push_back((v[i] + v[i + 1])/2.);
+            old.push_back(-1);
+        }
     }
+    return refined;
+}
 
-    std::array<std::vector<double>, 3> grid;
-    for(auto& n : grid)
+std::array<std::vector<double>, 3> pgfplotter::adaptive_mesh_grid(const
+    FieldBatch& f, double xMin, double xMax, double yMin, double yMax, double
+    tolerance, std::size_t maxEvaluations, std::size_t res)
+{
+    if(res < 2)
     {
-        n.resize(xRes*yRes);
+        throw std::runtime_error("Adaptive grid needs at least 2 points per "
+            "side.");
+    }
+    if(maxEvaluations < res*res)
+    {
+        throw std::runtime_error("Initial " + std::to_string(res) + " by " +
+            std::to_string(res) + " grid exceeds the limit of " + std::
+            to_string(maxEvaluations) + " evaluations.");
     }
 
-    std::vector<double> x(xRes);
-    std::vector<double> y(yRes);
-    for(std::size_t i = 0; i < xRes; ++i)
+    std::vector<double> x(res);
+    std::vector<double> y(res);
+    for(std::size_t i = 0; i < res; ++i)
     {
-        x[i] = xMin + i*(xMax - xMin)/(xRes - 1);
+        x[i] = xMin + i*(xMax - xMin)/(res - 1);
+        y[i] = yMin + i*(yMax - yMin)/(res - 1);
     }
-    for(std::size_t i = 0; i < yRes; ++i)
+    std::vector<double> z(res*res);
     {
-        y[i] = yMin + i*(yMax - yMin)/(yRes - 1);
+        std::vector<double> px(res*res);
+        std::vector<double> py(res*res);
+        for(std::size_t i = 0; i < res*res; ++i)
+        {
+            px[i] = x[i/res];
+            py[i] = y[i%res];
+        }
+        f(res*res, px.data(), py.data(), z.data());
     }
-    for(std::size_t i = 0; i < xRes; ++i)
+
+    while(true)
     {
-        for(std::size_t j = 0; j < yRes; ++j)
+        // Worst change across each column and row of cells, along x and y
+        // respectively, so a feature only refines the direction it varies in.
+        const std::size_t numX = x.size();
+        const std::size_t numY = y.size();
+        std::vector<double> errorX(numX - 1);
+        std::vector<double> errorY(numY - 1);
+        for(std::size_t i = 0; i < numX; ++i)
+        {
+            for(std::size_t j = 0; j < numY; ++j)
+            {
+                const double n = z[i*numY + j];
+                // NaN compares false, so undefined points are left alone.
+                if(i + 1 < numX && std::abs(z[(i + 1)*numY + j] - n) >
+                    tolerance)
+                {
+                    errorX[i] = std::max(errorX[i], std::abs(z[(i + 1)*numY +
+                        j] - n));
+                }
+                if(j + 1 < numY && std::abs(z[i*numY + j + 1] - n) > tolerance)
+                {
+                    errorY[j] = std::max(errorY[j], std::abs(z[i*numY + j + 1] -
+                        n));
+                }
+            }
+        }
+
+        // Split the worst intervals first while the grid fits.
+        std::vector<std::pair<double, std::ptrdiff_t>> candidates;
+        for(std::size_t i = 0; i < errorX.size(); ++i)
         {
-            grid[0][yRes*i + j] = x[i];
-            grid[1][yRes*i + j] = y[j];
-            grid[2][yRes*i + j] = f(x[i], y[j]);
+            if(errorX[i] > 0.)
+            {
+                candidates.push_back({errorX[i], i});
+            }
         }
+        for(std::size_t j = 0; j < errorY.size(); ++j)
+        {
+            if(errorY[j] > 0.)
+            {
+                candidates.push_back({errorY[j], -1 - static_cast<std::
+                    ptrdiff_t>(j)});
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const auto& a,
+            const auto& b)
+        {
+            return a.first > b.first;
+        });
+        std::vector<bool> splitX(numX - 1);
+        std::vector<bool> splitY(numY - 1);
+        std::size_t newX = numX;
+        std::size_t newY = numY;
+        for(const auto& n : candidates)
+        {
+            const bool isX = n.second >= 0;
+            if((newX + isX)*(newY + !isX) > maxEvaluations)
+            {
+                continue;
+            }
+            if(isX)
+            {
+                splitX[n.second] = true;
+                ++newX;
+            }
+            else
+            {
+                splitY[-1 - n.second] = true;
+                ++newY;
+            }
+        }
+        if(newX == numX && newY == numY)
+        {
+            break;
+        }
+
+        std::vector<std::ptrdiff_t> oldX;
+        std::vector<std::ptrdiff_t> oldY;
+        const std::vector<double> refinedX = refine(x, splitX, oldX);
+        const std::vector<double> refinedY = refine(y, splitY, oldY);
+        std::vector<double> refinedZ(newX*newY);
+        std::vector<std::size_t> missing;
+        std::vector<double> px;
+        std::vector<double> py;
+        for(std::size_t i = 0; i < newX; ++i)
+        {
+            for(std::size_t j = 0; j < newY; ++j)
+            {
+                if(oldX[i] >= 0 && oldY[j] >= 0)
+                {
+                    refinedZ[i*newY + j] = z[oldX[i]*numY + oldY[j]];
+                }
+                else
+                {
+                    missing.push_back(i*newY + j);
+                    px.push_back(refinedX[i]);
+                    py.push_back(refinedY[j]);
+                }
+            }
+        }
+        std::vector<double> pz(missing.size());
+        f(missing.size(), px.data(), py.data(), pz.data());
+        for(std::size_t i = 0; i < missing.size(); ++i)
+        {
+            refinedZ[missing[i]] = pz[i];
+        }
+
+        x = refinedX;
+        y = refinedY;
+        z = std::move(refinedZ);
     }
 
+    std::array<std::vector<double>, 3> grid;
+    for(auto& n : grid)
+    {
+        n.resize(x.size()*y.size());
+    }
+    for(std::size_t i = 0; i < x.size(); ++i)
+    {
+        for(std::size_t j = 0; j < y.size(); ++j)
+        {
+            grid[0][i*y.size() + j] = x[i];
+            grid[1][i*y.size() + j] = y[j];
+        }
+    }
+    grid[2] = std::move(z);
     return grid;
 }
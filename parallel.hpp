@@ -0,0 +1,104 @@
+#ifndef PGFPLOTTER_PARALLEL_HPP
+#define PGFPLOTTER_PARALLEL_HPP
+
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+
+namespace pgfplotter
+{
+    // Threads available to work started from the current thread. Zero means
+    // use all hardware threads. Nested `parallel_for` calls split the budget
+    // of their parent between workers, so they never oversubscribe.
+    inline thread_local unsigned int threadBudget = 0;
+
+    inline unsigned int thread_budget()
+    {
+        if(threadBudget)
+        {
+            return threadBudget;
+        }
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Sets the thread budget of the current thread for the lifetime of the
+    // object.
+    class ThreadBudget
+    {
+        unsigned int previous;
+
+    public:
+        explicit ThreadBudget(unsigned int n) : previous(threadBudget)
+        {
+            threadBudget = n;
+        }
+        ~ThreadBudget()
+        {
+            threadBudget = previous;
+        }
+        ThreadBudget(const ThreadBudget&) = delete;
+        ThreadBudget& operator=(const ThreadBudget&) = delete;
+    };
+
+    // Calls `f(i)` for every `i` in `[0, n)`, in no particular order, across
+    // up to `thread_budget()` threads including the calling one. The first
+    // exception thrown by `f` is rethrown once all workers have finished.
+    template<typename F>
+    void parallel_for(std::size_t n, F&& f)
+    {
+        const std::size_t numThreads = std::min<std::size_t>(n,
+            thread_budget());
+        if(numThreads <= 1)
+        {
+            for(std::size_t i = 0; i < n; ++i)
+            {
+                f(i);
+            }
+            return;
+        }
+
+        const unsigned int share = std::max<std::size_t>(1, thread_budget()/
+            numThreads);
+        std::atomic<std::size_t> next(0);
+        std::atomic<bool> failed(false);
+        std::exception_ptr error;
+        auto work = [&]()
+        {
+            ThreadBudget budget(share);
+            try
+            {
+                for(std::size_t i = next++; i < n && !failed; i = next++)
+                {
+                    f(i);
+                }
+            }
+            catch(...)
+            {
+                if(!failed.exchange(true))
+                {
+                    error = std::current_exception();
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(numThreads - 1);
+        for(std::size_t i = 1; i < numThreads; ++i)
+        {
+            threads.emplace_back(work);
+        }
+        work();
+        for(auto& t : threads)
+        {
+            t.join();
+        }
+        if(error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,873 @@
+#include "pgfplotter"
+#include "compile.hpp"
+#include "decimate.hpp"
+#include "contour.hpp"
+#include "deflate.hpp"
+#include <fstream>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <chrono>
+
+namespace
+{
+    // Resolution of previews. Lower than the typeset PNG, as there's no text
+    // to keep legible.
+    constexpr double PreviewDpi = 100.;
+    constexpr double PointsPerInch = 72.27;
+
+    // Space around the plot area of each axis, for the (absent) tick labels
+    // and axis labels, and between axes, in points.
+    constexpr double MarginLeft = 40.;
+    constexpr double MarginBottom = 28.;
+    constexpr double MarginTop = 8.;
+    constexpr double MarginRight = 8.;
+    constexpr double TitleHeight = 14.;
+    constexpr double VerticalSep = 1.3/2.54*PointsPerInch;
+
+    // Viridis, sampled at nine evenly spaced points.
+    constexpr std::array<std::array<int, 3>, 9> Viridis =
+    {{
+        { 68,   1,  84},
+        { 71,  44, 122},
+        { 59,  81, 139},
+        { 44, 113, 142},
+        { 33, 144, 141},
+        { 39, 173, 129},
+        { 92, 200,  99},
+        {170, 220,  50},
+        {253, 231,  37}
+    }};
+
+    using Rgb = std::array<double, 3>;
+
+    double points(double pt)
+    {
+        return pt/PointsPerInch*PreviewDpi;
+    }
+
+    Rgb rgb(const std::array<int, 3>& c)
+    {
+        return {static_cast<double>(c[0]), static_cast<double>(c[1]),
+            static_cast<double>(c[2])};
+    }
+
+    // Color of `t` in `[0, 1]` on viridis or the bidirectional colormap.
+    Rgb colormap(double t, bool bidir)
+    {
+        const std::array<int, 3>* map = bidir ? pgfplotter::Color::Bidir.
+            data() : Viridis.data();
+        const std::size_t n = bidir ? pgfplotter::Color::Bidir.size() :
+            Viridis.size();
+        const double s = std::clamp(t, 0., 1.)*(n - 1);
+        const std::size_t k = std::min(static_cast<std::size_t>(s), n - 2);
+        const double f = s - k;
+        Rgb c;
+        for(int i = 0; i < 3; ++i)
+        {
+            c[i] = map[k][i]*(1. - f) + map[k + 1][i]*f;
+        }
+        return c;
+    }
+
+    // RGB image drawn with antialiased shapes, clipped to a rectangle.
+    class Canvas
+    {
+        std::size_t width;
+        std::size_t height;
+        std::vector<unsigned char> pixels;
+        double clipX0 = 0.;
+        double clipY0 = 0.;
+        double clipX1;
+        double clipY1;
+
+        // Blends `c`, in 8-bit fixed point, by opacity `a`.
+        void blend(std::size_t x, std::size_t y, const std::array<unsigned int,
+            3>& c, double a)
+        {
+            const unsigned int weight = static_cast<unsigned int>(a*256. + 0.5);
+            unsigned char* p = pixels.data() + 3*(y*width + x);
+            for(int i = 0; i < 3; ++i)
+            {
+                p[i] = static_cast<unsigned char>((p[i]*(256 - weight) + c[i]*
+                    weight + 128) >> 8);
+            }
+        }
+
+    public:
+        Canvas(std::size_t width, std::size_t height) : width(width), height(
+            height), pixels(3*width*height, 255), clipX1(width), clipY1(
+            height) {}
+
+        void clip(double x0, double y0, double x1, double y1)
+        {
+            clipX0 = std::max(0., x0);
+            clipY0 = std::max(0., y0);
+            clipX1 = std::min(static_cast<double>(width), x1);
+            clipY1 = std::min(static_cast<double>(height), y1);
+        }
+        void unclip()
+        {
+            clip(0., 0., width, height);
+        }
+
+        // Blends `c` into the pixels in `[x0, x1]` by `[y0, y1]` with opacity
+        // `a` times the coverage `f(x, y)` at each pixel center.
+        template<typename F>
+        void shade(double x0, double y0, double x1, double y1, const Rgb& c,
+            double a, F&& f)
+        {
+            const double left = std::floor(std::max(x0, clipX0));
+            const double top = std::floor(std::max(y0, clipY0));
+            const double right = std::ceil(std::min(x1, clipX1));
+            const double bottom = std::ceil(std::min(y1, clipY1));
+            std::array<unsigned int, 3> color;
+            for(int i = 0; i < 3; ++i)
+            {
+                color[i] = static_cast<unsigned int>(c[i] + 0.5);
+            }
+            for(double y = top; y < bottom; ++y)
+            {
+                for(double x = left; x < right; ++x)
+                {
+                    const double coverage = f(x + 0.5, y + 0.5);
+                    if(coverage > 0.)
+                    {
+                        blend(static_cast<std::size_t>(x), static_cast<std::
+                            size_t>(y), color, a*std::min(coverage, 1.));
+                    }
+                }
+            }
+        }
+
+        // Axis-aligned rectangle with antialiased edges.
+        void rect(double x0, double y0, double x1, double y1, const Rgb& c,
+            double a)
+        {
+            if(x0 > x1)
+            {
+                std::swap(x0, x1);
+            }
+            if(y0 > y1)
+            {
+                std::swap(y0, y1);
+            }
+            shade(x0, y0, x1, y1, c, a, [&](double x, double y)
+            {
+                return std::clamp(std::min(x1, x + 0.5) - std::max(x0, x - 0.5),
+                    0., 1.)*std::clamp(std::min(y1, y + 0.5) - std::max(y0, y -
+                    0.5), 0., 1.);
+            });
+        }
+
+        // Segment of half width `r`. With a dash pattern `dash` (on and off
+        // lengths), `phase` is the distance along the line so far.
+        void line(double x0, double y0, double x1, double y1, double r, const
+            Rgb& c, double a, const double* dash, double& phase)
+        {
+            const double dx = x1 - x0;
+            const double dy = y1 - y0;
+            const double length2 = dx*dx + dy*dy;
+            const double length = std::sqrt(length2);
+            const double start = phase;
+            const double outer2 = (r + 0.5)*(r + 0.5);
+            const double inverse = length2 > 0. ? 1./length2 : 0.;
+            auto coverage = [&](double x, double y)
+            {
+                const double t = std::clamp(((x - x0)*dx + (y - y0)*dy)*inverse,
+                    0., 1.);
+                if(dash && std::fmod(start + t*length, dash[0] + dash[1]) >=
+                    dash[0])
+                {
+                    return 0.;
+                }
+                const double ex = x - x0 - t*dx;
+                const double ey = y - y0 - t*dy;
+                const double d2 = ex*ex + ey*ey;
+                return d2 >= outer2 ? 0. : r + 0.5 - std::sqrt(d2);
+            };
+            // Row by row, across only the part of the bounding box the
+            // segment passes through, so steep lines stay cheap.
+            const double reach = r + 1.;
+            for(double y = std::floor(std::max(std::min(y0, y1) - reach,
+                clipY0)); y < std::min(std::max(y0, y1) + reach, clipY1); ++y)
+            {
+                double left = std::min(x0, x1);
+                double right = std::max(x0, x1);
+                if(std::abs(dy) > 0.)
+                {
+                    const double t0 = std::clamp((y - reach - y0)/dy, 0., 1.);
+                    const double t1 = std::clamp((y + 1. + reach - y0)/dy, 0.,
+                        1.);
+                    left = x0 + std::min(t0, t1)*dx;
+                    right = x0 + std::max(t0, t1)*dx;
+                    if(left > right)
+                    {
+                        std::swap(left, right);
+                    }
+                }
+                shade(left - reach, y, right + reach, y + 1., c, a, coverage);
+            }
+            phase += length;
+        }
+
+        // Polygon filled by the even-odd rule, antialiased horizontally.
+        void polygon(const std::vector<double>& x, const std::vector<double>&
+            y, const Rgb& c, double a)
+        {
+            if(x.size() < 3)
+            {
+                return;
+            }
+            const auto [yMin, yMax] = std::minmax_element(y.begin(), y.end());
+            std::vector<double> crossings;
+            for(double row = std::floor(std::max(*yMin, clipY0)); row < std::
+                min(*yMax, clipY1); ++row)
+            {
+                const double yc = row + 0.5;
+                crossings.clear();
+                for(std::size_t i = 0, j = x.size() - 1; i < x.size(); j = i++)
+                {
+                    if((y[i] <= yc) != (y[j] <= yc))
+                    {
+                        crossings.push_back(x[i] + (yc - y[i])/(y[j] - y[i])*(
+                            x[j] - x[i]));
+                    }
+                }
+                std::sort(crossings.begin(), crossings.end());
+                for(std::size_t i = 0; i + 1 < crossings.size(); i += 2)
+                {
+                    rect(crossings[i], row, crossings[i + 1], row + 1., c, a);
+                }
+            }
+        }
+
+        // Writes an 8-bit RGB PNG, throwing if it can't.
+        void write_png(const std::string& path) const
+        {
+            // Each row as the difference from the one above, which leaves
+            // mostly zeros in flat areas.
+            const std::size_t stride = 3*width + 1;
+            std::string raw(stride*height, '\2');
+            for(std::size_t y = 0; y < height; ++y)
+            {
+                const unsigned char* row = pixels.data() + 3*y*width;
+                const unsigned char* above = y ? row - 3*width : nullptr;
+                char* out = &raw[y*stride + 1];
+                for(std::size_t x = 0; x < 3*width; ++x)
+                {
+                    out[x] = static_cast<char>(above ? row[x] - above[x] :
+                        row[x]);
+                }
+            }
+
+            std::string png = "\x89PNG\r\n\x1a\n";
+            auto u32 = [](std::string& s, std::uint32_t n)
+            {
+                for(int i = 24; i >= 0; i -= 8)
+                {
+                    s += static_cast<char>((n >> i) & 0xff);
+                }
+            };
+            auto chunk = [&](const std::string& type, const std::string& data)
+            {
+                u32(png, static_cast<std::uint32_t>(data.size()));
+                const std::string body = type + data;
+                png += body;
+                u32(png, pgfplotter::crc32(body.data(), body.size()));
+            };
+            std::string header;
+            u32(header, static_cast<std::uint32_t>(width));
+            u32(header, static_cast<std::uint32_t>(height));
+            // 8 bits per channel, RGB, default compression, filtering and no
+            // interlacing.
+            header += std::string("\x08\x02\x00\x00\x00", 5);
+            chunk("IHDR", header);
+            // A short search suffices for the long runs of a plot.
+            chunk("IDAT", pgfplotter::zlib_compress(raw.data(), raw.size(),
+                4));
+            chunk("IEND", "");
+
+            std::ofstream out(path, std::ios::binary);
+            out.write(png.data(), png.size());
+            if(!out)
+            {
+                throw std::runtime_error("Failed to write preview \"" + path +
+                    "\".");
+            }
+        }
+    };
+
+    // Maps axis coordinates to pixels.
+    struct Frame
+    {
+        double left;
+        double top;
+        double width;
+        double height;
+        double xLo;
+        double xHi;
+        double yLo;
+        double yHi;
+        bool xLog;
+        bool yLog;
+
+        double x(double v) const
+        {
+            return left + ((xLog ? std::log10(v) : v) - xLo)/(xHi - xLo)*width;
+        }
+        double y(double v) const
+        {
+            return top + height - ((yLog ? std::log10(v) : v) - yLo)/(yHi -
+                yLo)*height;
+        }
+        bool valid(double u, double v) const
+        {
+            return std::isfinite(u) && std::isfinite(v) && (!xLog || u > 0.) &&
+                (!yLog || v > 0.);
+        }
+    };
+
+    // About five evenly spaced ticks across `[lo, hi]`, in whole decades on
+    // log axes (where `lo` and `hi` are already logarithms).
+    std::vector<double> ticks(double lo, double hi, bool log)
+    {
+        double step;
+        if(log)
+        {
+            step = std::max(1., std::ceil((hi - lo)/6.));
+        }
+        else
+        {
+            const double raw = (hi - lo)/5.;
+            const double magnitude = std::pow(10., std::floor(std::log10(raw)));
+            const double r = raw/magnitude;
+            step = (r < 1.5 ? 1. : r < 3.5 ? 2. : r < 7.5 ? 5. : 10.)*magnitude;
+        }
+        std::vector<double> v;
+        for(double t = std::ceil(lo/step)*step; t <= hi + 1e-9*step; t += step)
+        {
+            v.push_back(t);
+        }
+        return v;
+    }
+
+    // Draws mark `mark` of radius `r` centered on `(x, y)`.
+    void draw_mark(Canvas& canvas, char mark, double x, double y, double r,
+        const Rgb& c, double a)
+    {
+        const double w = points(0.4);
+        double phase = 0.;
+        auto stroke = [&](double x0, double y0, double x1, double y1)
+        {
+            canvas.line(x + x0*r, y + y0*r, x + x1*r, y + y1*r, w, c, a,
+                nullptr, phase);
+        };
+        auto fill = [&](auto&& inside)
+        {
+            canvas.shade(x - r - 1., y - r - 1., x + r + 1., y + r + 1., c, a,
+                inside);
+        };
+        switch(mark)
+        {
+        case 'x':
+            stroke(-1., -1., 1., 1.);
+            stroke(-1., 1., 1., -1.);
+            break;
+        case '+':
+            stroke(-1., 0., 1., 0.);
+            stroke(0., -1., 0., 1.);
+            break;
+        case '|':
+            stroke(0., -1., 0., 1.);
+            break;
+        case '-':
+            stroke(-1., 0., 1., 0.);
+            break;
+        case 'o':
+            fill([&](double u, double v)
+            {
+                return w + 0.5 - std::abs(std::hypot(u - x, v - y) - r);
+            });
+            break;
+        case 's':
+            stroke(-1., -1., 1., -1.);
+            stroke(1., -1., 1., 1.);
+            stroke(1., 1., -1., 1.);
+            stroke(-1., 1., -1., -1.);
+            break;
+        case 'S':
+            canvas.rect(x - r, y - r, x + r, y + r, c, a);
+            break;
+        case 'd':
+        case 'D':
+            // A square rotated 45 degrees and scaled by 0.6, as typeset.
+            r *= 0.6*std::sqrt(2.);
+            if(mark == 'd')
+            {
+                stroke(0., -1., 1., 0.);
+                stroke(1., 0., 0., 1.);
+                stroke(0., 1., -1., 0.);
+                stroke(-1., 0., 0., -1.);
+                break;
+            }
+            fill([&](double u, double v)
+            {
+                return (r - std::abs(u - x) - std::abs(v - y))/std::sqrt(2.) +
+                    0.5;
+            });
+            break;
+        case '^':
+            stroke(0., -1., 0.866, 0.5);
+            stroke(0.866, 0.5, -0.866, 0.5);
+            stroke(-0.866, 0.5, 0., -1.);
+            break;
+        default:
+            fill([&](double u, double v)
+            {
+                return r + 0.5 - std::hypot(u - x, v - y);
+            });
+        }
+    }
+}
+
+class pgfplotter::Preview
+{
+    // Number of y values of surface `i` of `a`, as in `Axis::plot_src`.
+    static std::size_t num_rows(const Axis& a, std::size_t i)
+    {
+        std::size_t numRows = 1;
+        for(std::size_t j = 1; j < a.surfaceX[i].size() && a.surfaceX[i][j] ==
+            a.surfaceX[i][0]; ++j)
+        {
+            ++numRows;
+        }
+        return numRows;
+    }
+
+    // Draws `a` with its box (plot area and margins) at `top`.
+    static void draw(const Axis& a, Canvas& canvas, double top, double
+        boxWidth, double boxHeight)
+    {
+        // Data ranges for unset limits, and the range of point meta values
+        // for colormaps, over everything drawn.
+        const double Inf = std::numeric_limits<double>::infinity();
+        double xLo = Inf;
+        double xHi = -Inf;
+        double yLo = Inf;
+        double yHi = -Inf;
+        double metaLo = Inf;
+        double metaHi = -Inf;
+        auto extend = [&](double x, double y)
+        {
+            if(std::isfinite(x) && std::isfinite(y) && (!a.xLog || x > 0.) &&
+                (!a.yLog || y > 0.))
+            {
+                xLo = std::min(xLo, x);
+                xHi = std::max(xHi, x);
+                yLo = std::min(yLo, y);
+                yHi = std::max(yHi, y);
+            }
+        };
+        auto meta = [&](double v)
+        {
+            if(std::isfinite(v))
+            {
+                metaLo = std::min(metaLo, v);
+                metaHi = std::max(metaHi, v);
+            }
+        };
+        for(const auto& n : a.data)
+        {
+            const auto xs = n[0].segments();
+            const auto ys = n[1].segments();
+            for(std::size_t i = 0; i < xs.size() && i < ys.size(); ++i)
+            {
+                for(std::size_t j = 0; j < xs[i].size() && j < ys[i].size();
+                    ++j)
+                {
+                    extend(xs[i][j], ys[i][j]);
+                }
+            }
+            for(const auto& m : n[3].segments())
+            {
+                for(const double v : m)
+                {
+                    meta(v);
+                }
+            }
+        }
+        for(std::size_t i = 0; i < a.surfaceX.size(); ++i)
+        {
+            for(std::size_t j = 0; j < a.surfaceX[i].size(); ++j)
+            {
+                extend(a.surfaceX[i][j], a.surfaceY[i][j]);
+                meta(a.surfaceZ[i][j]);
+            }
+        }
+        for(std::size_t i = 0; i < a.fillX.size(); ++i)
+        {
+            for(std::size_t j = 0; j < a.fillX[i].size(); ++j)
+            {
+                extend(a.fillX[i][j], a.fillY[i][j]);
+            }
+        }
+        if(a.zMinSet)
+        {
+            metaLo = a.zMin;
+        }
+        if(a.zMaxSet)
+        {
+            metaHi = a.zMax;
+        }
+
+        Frame f;
+        f.xLog = a.xLog;
+        f.yLog = a.yLog;
+        f.left = points(MarginLeft);
+        f.top = top + points(MarginTop + (a._title.empty() ? 0. :
+            TitleHeight));
+        f.width = std::max(1., boxWidth - points(MarginLeft + MarginRight));
+        f.height = std::max(1., top + boxHeight - points(MarginBottom) - f.
+            top);
+        auto range = [](bool minSet, double min, bool maxSet, double max,
+            double lo, double hi, bool log, double& outLo, double& outHi)
+        {
+            lo = minSet ? min : lo;
+            hi = maxSet ? max : hi;
+            if(!(lo <= hi))
+            {
+                lo = log ? 1. : 0.;
+                hi = lo;
+            }
+            outLo = log ? std::log10(lo) : lo;
+            outHi = log ? std::log10(hi) : hi;
+            if(outLo == outHi)
+            {
+                outLo -= 1.;
+                outHi += 1.;
+            }
+        };
+        range(a.xMinSet, a.xMin, a.xMaxSet, a.xMax, xLo, xHi, a.xLog, f.xLo,
+            f.xHi);
+        range(a.yMinSet, a.yMin, a.yMaxSet, a.yMax, yLo, yHi, a.yLog, f.yLo,
+            f.yHi);
+        if(a.axisEqual || a.axisEqualImage)
+        {
+            // Widen the range of the more stretched axis to equal units.
+            const double sx = f.width/(f.xHi - f.xLo);
+            const double sy = f.height/(f.yHi - f.yLo);
+            double& lo = sx > sy ? f.xLo : f.yLo;
+            double& hi = sx > sy ? f.xHi : f.yHi;
+            const double extra = (sx > sy ? f.width/sy : f.height/sx) - (hi -
+                lo);
+            lo -= extra/2.;
+            hi += extra/2.;
+        }
+        auto metaColor = [&](double v)
+        {
+            return colormap(metaHi > metaLo ? (v - metaLo)/(metaHi - metaLo) :
+                0.5, a._bidirColormap);
+        };
+
+        canvas.clip(f.left, f.top, f.left + f.width, f.top + f.height);
+
+        for(std::size_t i = 0; i + 1 < a._bgBands.size(); i += 2)
+        {
+            canvas.rect(f.x(a._bgBands[i]), f.top, f.x(a._bgBands[i + 1]), f.
+                top + f.height, rgb(Color::Black), 0.1);
+        }
+
+        for(std::size_t i = 0; i < a.surfaceX.size(); ++i)
+        {
+            draw_surface(a, i, f, canvas, metaColor);
+        }
+
+        for(std::size_t i = 0; i < a.fillX.size(); ++i)
+        {
+            std::vector<double> x(a.fillX[i].size());
+            std::vector<double> y(a.fillY[i].size());
+            for(std::size_t j = 0; j < x.size() && j < y.size(); ++j)
+            {
+                x[j] = f.x(a.fillX[i][j]);
+                y[j] = f.y(a.fillY[i][j]);
+            }
+            canvas.polygon(x, y, a.fillColors[i][0] >= 0 ? rgb(a.fillColors[
+                i]) : rgb(Color::Black), 1.);
+        }
+
+        for(std::size_t i = 0; i < a.data.size(); ++i)
+        {
+            draw_series(a, i, f, canvas, metaColor);
+        }
+
+        // Frame and ticks on all four sides, pointing in.
+        canvas.unclip();
+        const Rgb black = rgb(Color::Black);
+        const double w = points(0.4)/2.;
+        const double tick = 0.15/2.54*PreviewDpi;
+        double phase = 0.;
+        const double right = f.left + f.width;
+        const double bottom = f.top + f.height;
+        canvas.line(f.left, f.top, right, f.top, w, black, 1., nullptr, phase);
+        canvas.line(right, f.top, right, bottom, w, black, 1., nullptr, phase);
+        canvas.line(right, bottom, f.left, bottom, w, black, 1., nullptr,
+            phase);
+        canvas.line(f.left, bottom, f.left, f.top, w, black, 1., nullptr,
+            phase);
+        for(const double t : ticks(f.xLo, f.xHi, f.xLog))
+        {
+            const double x = f.left + (t - f.xLo)/(f.xHi - f.xLo)*f.width;
+            canvas.line(x, bottom, x, bottom - tick, w, black, 1., nullptr,
+                phase);
+            canvas.line(x, f.top, x, f.top + tick, w, black, 1., nullptr,
+                phase);
+        }
+        for(const double t : ticks(f.yLo, f.yHi, f.yLog))
+        {
+            const double y = bottom - (t - f.yLo)/(f.yHi - f.yLo)*f.height;
+            canvas.line(f.left, y, f.left + tick, y, w, black, 1., nullptr,
+                phase);
+            canvas.line(right, y, right - tick, y, w, black, 1., nullptr,
+                phase);
+        }
+    }
+
+    // Draws surfaces and matrices as cells colored by height, seen from
+    // above, and contours as lines colored by level.
+    template<typename F>
+    static void draw_surface(const Axis& a, std::size_t i, const Frame& f,
+        Canvas& canvas, F&& metaColor)
+    {
+        const std::size_t numPoints = a.surfaceX[i].size();
+        if(a.surfaceY[i].size() != numPoints || a.surfaceZ[i].size() !=
+            numPoints)
+        {
+            throw std::runtime_error("Number of points in x, y, and z must matc"
+                "h.");
+        }
+        std::size_t numRows = num_rows(a, i);
+        if(!numPoints || numPoints%numRows)
+        {
+            return;
+        }
+        std::vector<double> x(a.surfaceX[i].begin(), a.surfaceX[i].end());
+        std::vector<double> y(a.surfaceY[i].begin(), a.surfaceY[i].end());
+        std::vector<double> z(a.surfaceZ[i].begin(), a.surfaceZ[i].end());
+
+        if(a.numContours[i])
+        {
+            double phase = 0.;
+            for(const auto& n : contour_lines(x.data(), y.data(), z.data(),
+                numPoints/numRows, numRows, a.numContours[i]))
+            {
+                const Rgb c = metaColor(n.level);
+                for(std::size_t j = 1; j < n.x.size(); ++j)
+                {
+                    canvas.line(f.x(n.x[j - 1]), f.y(n.y[j - 1]), f.x(n.x[j]),
+                        f.y(n.y[j]), points(0.8), c, 1., nullptr, phase);
+                }
+            }
+            return;
+        }
+
+        // No finer than the pixels, pooled as the typeset plot would be.
+        std::array<std::vector<double>, 3> pooled;
+        numRows = decimate_grid(x.data(), y.data(), z.data(), numPoints/
+            numRows, numRows, static_cast<std::size_t>(std::ceil(f.width)),
+            static_cast<std::size_t>(std::ceil(f.height)), a.gridSizes[i].
+            pooling, pooled);
+        const std::size_t numX = pooled[0].size()/numRows;
+        for(auto& n : pooled[0])
+        {
+            n = f.x(n);
+        }
+        for(auto& n : pooled[1])
+        {
+            n = f.y(n);
+        }
+        // Each cell reaches halfway to its neighbors, rounded to whole pixels
+        // so neighbors meet without antialiased seams.
+        auto edge = [&](const std::vector<double>& v, std::size_t k, std::
+            size_t step, std::size_t index, std::size_t count, bool after)
+        {
+            if(count == 1)
+            {
+                return std::round(v[k] + (after ? 0.5 : -0.5));
+            }
+            if(after ? index + 1 < count : index > 0)
+            {
+                return std::round((v[k] + v[after ? k + step : k - step])/2.);
+            }
+            const double other = v[after ? k - step : k + step];
+            return std::round(v[k] + (v[k] - other)/2.);
+        };
+        const double opacity = a.matrixSurf[i] ? 1. : a._opacity;
+        for(std::size_t j = 0; j < numX; ++j)
+        {
+            for(std::size_t k = 0; k < numRows; ++k)
+            {
+                const std::size_t m = j*numRows + k;
+                if(!std::isfinite(pooled[2][m]) || !std::isfinite(pooled[0][
+                    m]) || !std::isfinite(pooled[1][m]))
+                {
+                    continue;
+                }
+                canvas.rect(edge(pooled[0], m, numRows, j, numX, false), edge(
+                    pooled[1], m, 1, k, numRows, false), edge(pooled[0], m,
+                    numRows, j, numX, true), edge(pooled[1], m, 1, k, numRows,
+                    true), metaColor(pooled[2][m]), opacity);
+            }
+        }
+    }
+
+    template<typename F>
+    static void draw_series(const Axis& a, std::size_t i, const Frame& f,
+        Canvas& canvas, F&& metaColor)
+    {
+        const auto xs = a.data[i][0].segments();
+        const auto ys = a.data[i][1].segments();
+        const auto ws = a.data[i][3].segments();
+        if(a.data[i][1].size() != a.data[i][0].size())
+        {
+            throw std::runtime_error("Number of points in x and y must match.");
+        }
+        const bool fromW = a.colors[i][0] == Color::FromW[0] && !a.data[i][3].
+            empty();
+        const Rgb color = a.colors[i][0] >= 0 ? rgb(a.colors[i]) : rgb(
+            ColorCycle(i));
+        const double opacity = a.opacities[i];
+
+        MarkStyle mark = a.markers[i];
+        if(mark.mark < 0)
+        {
+            mark = {MarkCycle(i).mark, MarkCycle(i).size*a.markers[i].size,
+                a.markers[i].spacing};
+        }
+        const double markRadius = points(3.*mark.size);
+
+        // Ultra thick by default, densely dashed or dotted.
+        const double halfWidth = points(1.6*a.lineWidths[i])/2.;
+        const double dashed[2] = {points(3.), points(2.)};
+        const double dotted[2] = {points(1.), points(2.)};
+        const double* dash = a.lineStyles[i] == LineStyle::Dashed ? dashed :
+            a.lineStyles[i] == LineStyle::Dotted ? dotted : nullptr;
+
+        const std::size_t columns = static_cast<std::size_t>(std::ceil(f.
+            width));
+        // Markers already drawn at each pixel, to skip overdrawing dense
+        // scatter plots.
+        std::vector<bool> marked;
+        std::size_t index = 0;
+        double phase = 0.;
+        bool hasLast = false;
+        double lastX = 0.;
+        double lastY = 0.;
+        Rgb lastColor = color;
+        for(std::size_t s = 0; s < xs.size() && s < ys.size(); ++s)
+        {
+            const double* x = xs[s].data();
+            const double* y = ys[s].data();
+            const double* w = fromW && s < ws.size() ? ws[s].data() : nullptr;
+            const std::size_t n = std::min(xs[s].size(), ys[s].size());
+            // Lines without marks only need the extremes of each column.
+            std::vector<std::size_t> keep;
+            if(!mark.mark && !w && n > 4*columns)
+            {
+                keep = decimate_line(x, y, n, f.xLog ? std::pow(10., f.xLo) :
+                    f.xLo, f.xLog ? std::pow(10., f.xHi) : f.xHi, columns, f.
+                    xLog);
+            }
+            const std::size_t numKept = keep.empty() ? n : keep.size();
+            for(std::size_t k = 0; k < numKept; ++k, ++index)
+            {
+                const std::size_t j = keep.empty() ? k : keep[k];
+                if(!f.valid(x[j], y[j]))
+                {
+                    hasLast = false;
+                    continue;
+                }
+                const double px = f.x(x[j]);
+                const double py = f.y(y[j]);
+                const Rgb c = w ? metaColor(w[j]) : color;
+                if(a.lineStyles[i] != LineStyle::None && hasLast)
+                {
+                    Rgb mid;
+                    for(int l = 0; l < 3; ++l)
+                    {
+                        mid[l] = (c[l] + lastColor[l])/2.;
+                    }
+                    canvas.line(lastX, lastY, px, py, halfWidth, mid, opacity,
+                        dash, phase);
+                }
+                hasLast = true;
+                lastX = px;
+                lastY = py;
+                lastColor = c;
+
+                if(mark.mark > 0 && (!mark.spacing || index%mark.spacing == 0))
+                {
+                    if(px < f.left || py < f.top || px >= f.left + f.width ||
+                        py >= f.top + f.height)
+                    {
+                        continue;
+                    }
+                    if(marked.empty())
+                    {
+                        marked.resize(columns*static_cast<std::size_t>(std::
+                            ceil(f.height)));
+                    }
+                    const std::size_t pixel = static_cast<std::size_t>(py - f.
+                        top)*columns + static_cast<std::size_t>(px - f.left);
+                    if(!w && marked[pixel])
+                    {
+                        continue;
+                    }
+                    marked[pixel] = true;
+                    draw_mark(canvas, mark.mark, px, py, markRadius, c,
+                        opacity);
+                }
+            }
+        }
+    }
+
+public:
+    static std::string render(const std::string& path, const std::vector<const
+        Axis*>& p, const PlotOptions& options)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        if(path.empty())
+        {
+            throw std::runtime_error("Plot name is empty.");
+        }
+        const double width = std::ceil(TextWidth*PreviewDpi);
+        double height = 0.;
+        for(std::size_t i = 0; i < p.size(); ++i)
+        {
+            height += (i ? points(VerticalSep) : 0.) + p[i]->relHeight*
+                TextWidth*PreviewDpi;
+        }
+        Canvas canvas(static_cast<std::size_t>(width), static_cast<std::
+            size_t>(std::ceil(height)));
+        double top = 0.;
+        for(const auto* n : p)
+        {
+            const double boxHeight = n->relHeight*TextWidth*PreviewDpi;
+            draw(*n, canvas, top, n->relWidth*TextWidth*PreviewDpi, boxHeight);
+            top += boxHeight + points(VerticalSep);
+        }
+        canvas.write_png(path + ".png");
+
+        PlotStats stats;
+        stats.stages.push_back({"preview", std::chrono::duration<double>(std::
+            chrono::steady_clock::now() - start).count()});
+        report_stats(path, stats, options.stats);
+        return warning_lines(stats);
+    }
+};
+
+std::string pgfplotter::render_preview(const std::string& path, const std::
+    vector<const Axis*>& p, const PlotOptions& options)
+{
+    return Preview::render(path, p, options);
+}
@@ -0,0 +1,98 @@
+#include "pgfplotter"
+#include <algorithm>
+
+void pgfplotter::Series::push(const double* values, std::size_t n)
+{
+    if(!chunks)
+    {
+        throw std::runtime_error("Series handle is empty.");
+    }
+    const std::size_t numColumns = 2 + chunks->is3D + chunks->hasMeta;
+    if(n != numColumns)
+    {
+        throw std::runtime_error("Series has " + std::to_string(numColumns) +
+            " columns but " + std::to_string(n) + " values were appended.");
+    }
+
+    const std::size_t offset = chunks->size%SeriesChunks::ChunkSize;
+    for(std::size_t j = 0; j < 4; ++j)
+    {
+        if((j == 2 && !chunks->is3D) || (j == 3 && !chunks->hasMeta))
+        {
+            continue;
+        }
+        auto& c = chunks->columns[j];
+        if(!offset)
+        {
+            c.emplace_back(new double[SeriesChunks::ChunkSize]);
+        }
+        c.back()[offset] = *values++;
+    }
+    ++chunks->size;
+}
+
+void pgfplotter::Series::append(double x, double y)
+{
+    const double values[] = {x, y};
+    push(values, 2);
+}
+
+void pgfplotter::Series::append(double x, double y, double v)
+{
+    const double values[] = {x, y, v};
+    push(values, 3);
+}
+
+void pgfplotter::Series::append(double x, double y, double z, double w)
+{
+    const double values[] = {x, y, z, w};
+    push(values, 4);
+}
+
+void pgfplotter::Series::append(ArrayView x, ArrayView y, ArrayView z,
+    ArrayView w)
+{
+    if(!chunks)
+    {
+        throw std::runtime_error("Series handle is empty.");
+    }
+    const std::size_t n = x.size();
+    if(y.size() != n || z.size() != (chunks->is3D ? n : 0) || w.size() != (
+        chunks->hasMeta ? n : 0))
+    {
+        throw std::runtime_error("Appended columns don't match the series.");
+    }
+
+    const ArrayView values[] = {x, y, z, w};
+    for(std::size_t i = 0; i < n;)
+    {
+        const std::size_t offset = chunks->size%SeriesChunks::ChunkSize;
+        const std::size_t count = std::min(n - i, SeriesChunks::ChunkSize -
+            offset);
+        for(std::size_t j = 0; j < 4; ++j)
+        {
+            if(values[j].empty())
+            {
+                continue;
+            }
+            auto& c = chunks->columns[j];
+            if(!offset)
+            {
+                c.emplace_back(new double[SeriesChunks::ChunkSize]);
+            }
+            std::copy(values[j].data() + i, values[j].data() + i + count, c.
+                back().get() + offset);
+        }
+        chunks->size += count;
+        i += count;
+    }
+}
+
+std::size_t pgfplotter::Series::size() const
+{
+    if(!chunks)
+    {
+        throw std::runtime_error("Series handle is empty.");
+    }
+    return chunks->size;
+}
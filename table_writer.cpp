@@ -0,0 +1,171 @@
+#include "table_writer.hpp"
+#include "parallel.hpp"
+#include <charconv>
+#include <cstdio>
+#include <stdexcept>
+
+// Upper bound on the length of one formatted value plus its separator.
+static constexpr std::size_t MaxChars = 32;
+
+char* pgfplotter::format_double(char* first, char* last, double x, unsigned int
+    precision)
+{
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    const auto result = std::to_chars(first, last, x, std::chars_format::
+        general, static_cast<int>(precision));
+    return result.ec == std::errc() ? result.ptr : nullptr;
+#else
+    const int n = std::snprintf(first, last - first, "%.*g", static_cast<int>(
+        precision), x);
+    return n >= 0 && n < last - first ? first + n : nullptr;
+#endif
+}
+
+// Appends rows `[begin, end)` to `s`.
+static void format_rows(std::string& s, const std::vector<const double*>&
+    columns, std::size_t begin, std::size_t end)
+{
+    const std::size_t rowChars = MaxChars*columns.size();
+    std::size_t size = s.size();
+    s.resize(size + rowChars*(end - begin));
+    char* const last = s.data() + s.size();
+    char* p = s.data() + size;
+    for(std::size_t i = begin; i < end; ++i)
+    {
+        for(std::size_t j = 0; j < columns.size(); ++j)
+        {
+            if(j)
+            {
+                *p++ = ' ';
+            }
+            p = pgfplotter::format_double(p, last, columns[j][i]);
+        }
+        *p++ = '\n';
+    }
+    s.resize(p - s.data());
+}
+
+pgfplotter::TableWriter::TableWriter(const std::string& path) : path(path), out(
+    path, std::ios::binary)
+{
+    if(!out)
+    {
+        throw std::runtime_error("Failed to open temporary output file \"" +
+            path + "\".");
+    }
+    buffer.reserve(BlockSize + ChunkRows*MaxChars);
+}
+
+pgfplotter::TableWriter::~TableWriter()
+{
+    if(out.is_open())
+    {
+        try
+        {
+            flush();
+        }
+        catch(...) {}
+    }
+}
+
+void pgfplotter::TableWriter::flush()
+{
+    out.write(buffer.data(), buffer.size());
+    buffer.clear();
+    if(!out)
+    {
+        throw std::runtime_error("Failed to write temporary output file \"" +
+            path + "\".");
+    }
+}
+
+void pgfplotter::TableWriter::line(const std::string& line)
+{
+    buffer += line;
+    buffer += '\n';
+    if(buffer.size() >= BlockSize)
+    {
+        flush();
+    }
+}
+
+void pgfplotter::TableWriter::rows(const std::vector<const double*>& columns,
+    std::size_t numRows)
+{
+    rows({{columns, numRows}});
+}
+
+void pgfplotter::TableWriter::rows(const std::vector<TableBlock>& blocks)
+{
+    // Rows `[begin, end)` of a block.
+    struct Chunk
+    {
+        const TableBlock* block;
+        std::size_t begin;
+        std::size_t end;
+    };
+    std::vector<Chunk> chunks;
+    for(const auto& n : blocks)
+    {
+        for(std::size_t i = 0; i < n.numRows; i += ChunkRows)
+        {
+            chunks.push_back({&n, i, std::min(n.numRows, i + ChunkRows)});
+        }
+    }
+
+    const std::size_t numThreads = thread_budget();
+    if(chunks.size() <= 1 || numThreads <= 1)
+    {
+        // Rows are still formatted chunk by chunk so the buffer stays bounded.
+        for(const auto& n : chunks)
+        {
+            format_rows(buffer, n.block->columns, n.begin, n.end);
+            if(buffer.size() >= BlockSize)
+            {
+                flush();
+            }
+        }
+        return;
+    }
+
+    // Format a few chunks per thread at a time and write them in order, which
+    // keeps the output deterministic and memory use independent of the
+    // number of rows.
+    flush();
+    std::vector<std::string> formatted(2*numThreads);
+    for(std::size_t first = 0; first < chunks.size(); first += formatted.
+        size())
+    {
+        const std::size_t n = std::min(formatted.size(), chunks.size() -
+            first);
+        parallel_for(n, [&](std::size_t i)
+        {
+            const Chunk& chunk = chunks[first + i];
+            formatted[i].clear();
+            format_rows(formatted[i], chunk.block->columns, chunk.begin, chunk.
+                end);
+        });
+        for(std::size_t i = 0; i < n; ++i)
+        {
+            out.write(formatted[i].data(), formatted[i].size());
+        }
+        if(!out)
+        {
+            throw std::runtime_error("Failed to write temporary output file \""
+                + path + "\".");
+        }
+    }
+}
+
+std::uintmax_t pgfplotter::TableWriter::close()
+{
+    flush();
+    const auto size = out.tellp();
+    out.close();
+    if(!out)
+    {
+        throw std::runtime_error("Failed to close temporary output file \"" +
+            path + "\".");
+    }
+    return static_cast<std::uintmax_t>(size);
+}
@@ -0,0 +1,57 @@
+#ifndef PGFPLOTTER_TABLE_WRITER_HPP
+#define PGFPLOTTER_TABLE_WRITER_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+
+namespace pgfplotter
+{
+    // Formats `x` like `printf("%.*g", precision, x)` into `[first, last)` and
+    // returns one past the last character written, or `nullptr` if the buffer
+    // is too small.
+    char* format_double(char* first, char* last, double x, unsigned int
+        precision = 10);
+
+    // Rows of a table held in contiguous columns.
+    struct TableBlock
+    {
+        std::vector<const double*> columns;
+        std::size_t numRows;
+    };
+
+    // Writes whitespace-separated tables of doubles, one row per line, in the
+    // format read by pgfplots' `table`. Output is collected in large blocks
+    // instead of being flushed per row, and large tables are formatted in
+    // chunks on several threads.
+    class TableWriter
+    {
+        std::string path;
+        std::ofstream out;
+        std::string buffer;
+
+        void flush();
+
+    public:
+        static constexpr std::size_t BlockSize = 1 << 20;
+        static constexpr std::size_t ChunkRows = 1 << 16;
+
+        explicit TableWriter(const std::string& path);
+        ~TableWriter();
+
+        // Writes `line` followed by a newline.
+        void line(const std::string& line);
+        // Writes `numRows` rows taking the `j`th value of row `i` from
+        // `columns[j][i]`.
+        void rows(const std::vector<const double*>& columns, std::size_t
+            numRows);
+        // Writes the rows of each block in turn.
+        void rows(const std::vector<TableBlock>& blocks);
+        // Flushes and closes the file, throwing if any write failed. Returns
+        // the size of the file.
+        std::uintmax_t close();
+    };
+}
+
+#endif
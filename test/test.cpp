@@ -1,8 +1,14 @@
 #include "pgfplotter"
+#include "contour.hpp"
+#include "decimate.hpp"
+#include "hash.hpp"
+#include "zip.hpp"
 #include <filesystem>
 #include <cmath>
 #include <sstream>
 #include <fstream>
+#include <iterator>
+#include <limits>
 
 #define CATCH \
     catch(const std::exception& e) \
@@ -162,4 +168,410 @@ int main(int, char** argv)
         pgf::plot(outputDir + "/" + PlotName + "-2", v);
     }
     CATCH
+
+    try
+    {
+        pgf::plot_async(outputDir + "/" + PlotName + "-3", p, q).get();
+        if(!std::filesystem::exists(outputDir + "/" + PlotName + "-3.png"))
+        {
+            throw std::runtime_error("Did not generate plot asynchronously.");
+        }
+    }
+    CATCH
+
+    try
+    {
+        const auto results = pgf::plot_batch({
+            {outputDir + "/" + PlotName + "-4", {&p}, {}},
+            {outputDir + "/" + PlotName + "-5", {&q}, {}}
+        });
+        for(const auto& n : results)
+        {
+            if(!n.success)
+            {
+                throw std::runtime_error(n.message);
+            }
+        }
+    }
+    CATCH
+
+    try
+    {
+        pgf::PlotStats stats;
+        pgf::PlotOptions options;
+        options.pipeline = pgf::Pipeline::Direct;
+        options.stats = &stats;
+        std::size_t numReported = 0;
+        pgf::set_stats_hook([&](const std::string&, const pgf::PlotStats&)
+        {
+            ++numReported;
+        });
+        pgf::plot(outputDir + "/" + PlotName + "-6", {&p}, options);
+        pgf::set_stats_hook({});
+        if(!std::filesystem::exists(outputDir + "/" + PlotName + "-6.png") ||
+            stats.stages.size() != 4)
+        {
+            throw std::runtime_error("Did not plot without PostScript.");
+        }
+        if(numReported != 1 || stats.subplots.size() != 1 || !stats.subplots[
+            0].points || !stats.subplots[0].bytes || stats.stages[1].exitCode)
+        {
+            throw std::runtime_error("Did not report plot statistics.");
+        }
+    }
+    CATCH
+
+    try
+    {
+        pgf::PlotOptions options;
+        options.cache = true;
+        options.cacheDir = outputDir + "/cache";
+        pgf::plot(outputDir + "/" + PlotName + "-7", {&p}, options);
+        const std::uint64_t hits = pgf::cache_stats().hits;
+        pgf::plot(outputDir + "/" + PlotName + "-7", {&p}, options);
+        if(pgf::cache_stats().hits != hits + 1 || !std::filesystem::exists(
+            outputDir + "/" + PlotName + "-7.png"))
+        {
+            throw std::runtime_error("Did not reuse cached plot.");
+        }
+
+        // The key doesn't depend on the plot name.
+        pgf::plot(outputDir + "/" + PlotName + "-7b", {&p}, options);
+        if(pgf::cache_stats().hits != hits + 2)
+        {
+            throw std::runtime_error("Did not reuse cached plot by contents.");
+        }
+    }
+    CATCH
+
+    try
+    {
+        pgf::Axis r;
+        pgf::Series series = r.series(pgf::BasicLine);
+        for(int i = 0; i < 100; ++i)
+        {
+            series.append(i, i*i);
+        }
+        pgf::plot(outputDir + "/" + PlotName + "-8", {&r});
+        if(series.size() != 100 || !std::filesystem::exists(outputDir + "/" +
+            PlotName + "-8.png"))
+        {
+            throw std::runtime_error("Did not plot appended series.");
+        }
+    }
+    CATCH
+
+    try
+    {
+        pgf::Axis layout;
+        layout.setXLabel("$t$");
+        const auto result = pgf::animate(outputDir + "/" + PlotName + "-9",
+            layout, 3, [](std::size_t frame, pgf::Axis& a)
+            {
+                a.draw(pgf::BasicLine, {0., 1.}, {0., frame + 1.});
+            });
+        for(const auto& n : result.frames)
+        {
+            if(!n.success)
+            {
+                throw std::runtime_error(n.message);
+            }
+        }
+        if(result.numRendered != 3 || !std::filesystem::exists(outputDir +
+            "/" + PlotName + "-9-2.png"))
+        {
+            throw std::runtime_error("Did not render animation frames.");
+        }
+    }
+    CATCH
+
+    try
+    {
+        pgf::PlotOptions options;
+        options.preview = true;
+        pgf::plot(outputDir + "/" + PlotName + "-10", {&p, &q}, options);
+        std::ifstream in(outputDir + "/" + PlotName + "-10.png", std::ios::
+            binary);
+        std::string signature(8, '\0');
+        in.read(signature.data(), signature.size());
+        if(signature != "\x89PNG\r\n\x1a\n")
+        {
+            throw std::runtime_error("Did not render preview.");
+        }
+    }
+    CATCH
+
+    try
+    {
+        pgf::PlotOptions options;
+        options.format = pgf::OutputFormat::PDF;
+        options.archive = false;
+        pgf::plot(outputDir + "/" + PlotName + "-11", {&p}, options);
+        options.format = pgf::OutputFormat::TeX;
+        pgf::plot(outputDir + "/" + PlotName + "-12", {&p}, options);
+        if(!std::filesystem::exists(outputDir + "/" + PlotName + "-11.pdf") ||
+            std::filesystem::exists(outputDir + "/" + PlotName + "-11.png") ||
+            std::filesystem::exists(outputDir + "/" + PlotName +
+            "-11_plot_data") || !std::filesystem::exists(outputDir + "/" +
+            PlotName + "-12_plot_data/" + PlotName + "-12.tex"))
+        {
+            throw std::runtime_error("Did not plot to PDF and TeX.");
+        }
+        // TeX output is built elsewhere, so mustn't depend on local files.
+        std::ifstream in(outputDir + "/" + PlotName + "-12_plot_data/Makefil"
+            "e");
+        const std::string makefile((std::istreambuf_iterator<char>(in)), std::
+            istreambuf_iterator<char>());
+        if(makefile.find("\nFMT =\n") == std::string::npos || makefile.find(
+            std::filesystem::temp_directory_path().string()) != std::string::
+            npos)
+        {
+            throw std::runtime_error("TeX output Makefile is not self-containe"
+                "d.");
+        }
+    }
+    CATCH
+
+    try
+    {
+        pgf::PlotOptions options;
+        options.scratchDir = outputDir + "/scratch";
+        pgf::plot(outputDir + "/" + PlotName + "-13", {&q}, options);
+        if(!std::filesystem::exists(outputDir + "/" + PlotName + "-13.png") ||
+            !std::filesystem::exists(outputDir + "/" + PlotName +
+            "-13_plot_data.zip") || !std::filesystem::is_empty(outputDir +
+            "/scratch"))
+        {
+            throw std::runtime_error("Did not plot through scratch directory.");
+        }
+    }
+    CATCH
+
+    try
+    {
+        pgf::PlotOptions options;
+        options.stageTimeout = 1e-3;
+        const auto results = pgf::plot_batch({{outputDir + "/" + PlotName +
+            "-14", {&q}, options}});
+        if(!results[0].error)
+        {
+            throw std::runtime_error("Did not reach stage time limit.");
+        }
+        try
+        {
+            std::rethrow_exception(results[0].error);
+        }
+        catch(const pgf::LimitError& e)
+        {
+            if(e.limit() != pgf::Limit::StageTimeout || e.stage() != "lualatex")
+            {
+                throw std::runtime_error("Wrong limit reached.");
+            }
+        }
+    }
+    CATCH
+
+    try
+    {
+        const auto data = pgf::mesh_grid([](double x, double y){ return x*y;
+            }, 0., 1., 0., 1., 50);
+        pgf::Axis r;
+        r.surf(data[0], data[1], data[2]);
+        r.surf(data[0], data[1], data[2]);
+        r.setGridSize(10, 10);
+        pgf::PlotOptions options;
+        options.format = pgf::OutputFormat::TeX;
+        pgf::PlotStats stats;
+        options.stats = &stats;
+        pgf::plot(outputDir + "/" + PlotName + "-15", {&r}, options);
+        // Only the grid asked to be is pooled.
+        const auto& pooled = stats.subplots.at(0).pooledGrids;
+        if(pooled.size() != 1 || pooled[0].surface != 1 || pooled[0].before !=
+            std::array<std::size_t, 2>{50, 50} || pooled[0].after != std::
+            array<std::size_t, 2>{10, 10})
+        {
+            throw std::runtime_error("Did not pool surface grid as set.");
+        }
+    }
+    CATCH
+
+    try
+    {
+        // A cone, whose only contour is a circle of half its height.
+        const auto data = pgf::mesh_grid([](double x, double y){ return std::
+            hypot(x, y); }, -1., 1., -1., 1., 41);
+        const auto lines = pgf::contour_lines(data[0].data(), data[1].data(),
+            data[2].data(), 41, 41, 1);
+        const double level = std::sqrt(2.)/2.;
+        if(lines.size() != 1 || std::abs(lines[0].level - level) > 1e-12 ||
+            lines[0].x.size() < 40 || lines[0].x.front() != lines[0].x.back() ||
+            lines[0].y.front() != lines[0].y.back())
+        {
+            throw std::runtime_error("Did not find one closed cone contour.");
+        }
+        for(std::size_t i = 0; i < lines[0].x.size(); ++i)
+        {
+            if(std::abs(std::hypot(lines[0].x[i], lines[0].y[i]) - level) >
+                0.01)
+            {
+                throw std::runtime_error("Cone contour is not a circle.");
+            }
+        }
+    }
+    CATCH
+
+    try
+    {
+        // A step, which would be refined without end but for the cap.
+        std::size_t numEvaluations = 0;
+        const auto grid = pgf::adaptive_mesh_grid(pgf::FieldBatch([&](std::
+            size_t n, const double* x, const double*, double* z)
+            {
+                numEvaluations += n;
+                for(std::size_t i = 0; i < n; ++i)
+                {
+                    z[i] = x[i] < 0.3 ? 0. : 1.;
+                }
+            }), 0., 1., 0., 1., 0.1, 1000);
+        if(numEvaluations > 1000 || numEvaluations != grid[2].size() ||
+            numEvaluations <= 16*16)
+        {
+            throw std::runtime_error("Evaluated adaptive grid " + std::
+                to_string(numEvaluations) + " times.");
+        }
+    }
+    CATCH
+
+    try
+    {
+        const std::string text = "The quick brown fox jumps over the lazy dog"
+            "\n";
+        {
+            std::ofstream out(outputDir + "/fox.txt");
+            for(int i = 0; i < 1000; ++i)
+            {
+                out << text;
+            }
+        }
+        {
+            pgf::ZipWriter zip(outputDir + "/fox.zip");
+            zip.add_file("fox.txt", outputDir + "/fox.txt");
+            zip.close();
+        }
+        // The CRC and sizes in the local header, little-endian.
+        std::ifstream in(outputDir + "/fox.zip", std::ios::binary);
+        const std::string zip((std::istreambuf_iterator<char>(in)), std::
+            istreambuf_iterator<char>());
+        auto field = [&](std::size_t offset)
+        {
+            std::uint32_t n = 0;
+            for(std::size_t i = 0; i < 4; ++i)
+            {
+                n |= static_cast<std::uint32_t>(static_cast<unsigned char>(zip.
+                    at(offset + i))) << 8*i;
+            }
+            return n;
+        };
+        if(field(0) != 0x04034b50 || field(14) != 0x2d7f808a || field(22) !=
+            44000 || field(18) >= 44000)
+        {
+            throw std::runtime_error("Archive header does not match contents.");
+        }
+    }
+    CATCH
+
+    try
+    {
+        // From FIPS 180-2, the second across two blocks.
+        pgf::Hash abc;
+        abc.update("abc");
+        pgf::Hash two;
+        two.update("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq");
+        if(abc.hex() != "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff"
+            "61f20015ad" || two.hex() != "248d6a61d20638b8e5c026930c3e6039a33c"
+            "e45964ff2167f6ecedd419db06c1")
+        {
+            throw std::runtime_error("Wrong SHA-256 digest.");
+        }
+    }
+    CATCH
+
+    try
+    {
+        // A smooth line with one spike and one gap, far longer than the
+        // pixel columns it is drawn in.
+        constexpr std::size_t NumPoints = 200000;
+        constexpr std::size_t Spike = 123457;
+        constexpr std::size_t Gap = 150000;
+        constexpr std::size_t NumColumns = 1000;
+        std::vector<double> x(NumPoints);
+        std::vector<double> y(NumPoints);
+        for(std::size_t i = 0; i < NumPoints; ++i)
+        {
+            x[i] = static_cast<double>(i)/NumPoints;
+            y[i] = std::sin(TwoPi*x[i]);
+        }
+        y[Spike] = 100.;
+        y[Gap] = std::nan("");
+        const auto keep = pgf::decimate_line(x.data(), y.data(), NumPoints,
+            0., 1., NumColumns, false);
+        if(std::find(keep.begin(), keep.end(), Spike) == keep.end() || std::
+            find(keep.begin(), keep.end(), Gap) == keep.end())
+        {
+            throw std::runtime_error("Dropped the spike or the gap.");
+        }
+        // The lowest and highest value of each column, of all and of the
+        // kept points.
+        auto extremes = [&](auto&& indices)
+        {
+            constexpr double Inf = std::numeric_limits<double>::infinity();
+            std::vector<double> lo(NumColumns, Inf);
+            std::vector<double> hi(NumColumns, -Inf);
+            for(const std::size_t i : indices)
+            {
+                const std::size_t column = static_cast<std::size_t>(x[i]*
+                    NumColumns);
+                if(std::isfinite(y[i]))
+                {
+                    lo[column] = std::min(lo[column], y[i]);
+                    hi[column] = std::max(hi[column], y[i]);
+                }
+            }
+            return std::make_pair(lo, hi);
+        };
+        std::vector<std::size_t> all(NumPoints);
+        for(std::size_t i = 0; i < NumPoints; ++i)
+        {
+            all[i] = i;
+        }
+        if(keep.size() > 4*NumColumns + 1 || extremes(keep) != extremes(all))
+        {
+            throw std::runtime_error("Did not keep the extremes of each column"
+                ".");
+        }
+
+        pgf::Axis r;
+        r.draw(pgf::BasicLine, std::move(x), std::move(y));
+        r.decimate();
+        pgf::PlotOptions options;
+        options.format = pgf::OutputFormat::TeX;
+        options.archive = false;
+        pgf::PlotStats stats;
+        options.stats = &stats;
+        pgf::plot(outputDir + "/" + PlotName + "-16", {&r}, options);
+        // All rows but the header.
+        std::ifstream in(outputDir + "/" + PlotName + "-16_plot_data/0.0.data");
+        std::size_t numRows = 0;
+        for(std::string line; std::getline(in, line);)
+        {
+            ++numRows;
+        }
+        if(numRows < 2 || stats.droppedPoints == 0 || stats.droppedPoints !=
+            NumPoints - (numRows - 1))
+        {
+            throw std::runtime_error("Dropped point count does not match the "
+                "data written.");
+        }
+    }
+    CATCH
 }
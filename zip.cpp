@@ -0,0 +1,268 @@
+#include "zip.hpp"
+#include "deflate.hpp"
+#include "parallel.hpp"
+#include <filesystem>
+#include <algorithm>
+#include <stdexcept>
+#include <ctime>
+#include <mutex>
+#include <map>
+
+namespace
+{
+    // Input deflated independently of the rest, so pieces can be compressed
+    // in parallel for little loss in ratio.
+    constexpr std::size_t PieceSize = 1 << 20;
+    // Files at least this large may not fit 32-bit sizes once compressed,
+    // allowing for the overhead of stored blocks, so get ZIP64 sizes.
+    constexpr std::uint64_t Zip64Size = 0xff000000;
+    constexpr std::uint64_t Max32 = 0xffffffff;
+    constexpr std::uint64_t Max16 = 0xffff;
+    // Made by Unix, to version 2.0 or 4.5 (ZIP64) of the format.
+    constexpr std::uint16_t Unix = 3 << 8;
+
+    // `std::localtime` isn't thread-safe.
+    std::mutex timeMutex;
+
+    // Appends `n` as `bytes` little-endian bytes.
+    void put(std::string& s, std::uint64_t n, int bytes)
+    {
+        for(int i = 0; i < bytes; ++i)
+        {
+            s += static_cast<char>((n >> 8*i) & 0xff);
+        }
+    }
+}
+
+pgfplotter::ZipWriter::ZipWriter(const std::string& path) : path(path), out(
+    path, std::ios::binary)
+{
+    if(!out)
+    {
+        throw std::runtime_error("Unable to open archive \"" + path + "\".");
+    }
+
+    const std::time_t now = std::time(nullptr);
+    std::lock_guard<std::mutex> lock(timeMutex);
+    const std::tm* t = std::localtime(&now);
+    // 1980-01-01, the earliest time there is, if the clock is unusable.
+    time = t ? static_cast<std::uint16_t>(t->tm_hour << 11 | t->tm_min << 5 |
+        t->tm_sec/2) : 0;
+    date = t && t->tm_year >= 80 ? static_cast<std::uint16_t>((t->tm_year -
+        80) << 9 | (t->tm_mon + 1) << 5 | t->tm_mday) : 1 << 5 | 1;
+}
+
+pgfplotter::ZipWriter::~ZipWriter()
+{
+    if(!closed)
+    {
+        out.close();
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    }
+}
+
+void pgfplotter::ZipWriter::add_file(const std::string& name, const std::
+    string& file)
+{
+    std::ifstream in(file, std::ios::binary);
+    if(!in)
+    {
+        throw std::runtime_error("Unable to open \"" + file + "\" to archive.");
+    }
+    const bool zip64 = std::filesystem::file_size(file) >= Zip64Size;
+
+    Entry entry{name, 0, 0, 0, static_cast<std::uint64_t>(out.tellp())};
+    // The CRC and sizes are filled in once known.
+    std::string header;
+    put(header, 0x04034b50, 4);
+    put(header, zip64 ? 45 : 20, 2);
+    put(header, 0, 2);
+    // Deflated.
+    put(header, 8, 2);
+    put(header, time, 2);
+    put(header, date, 2);
+    put(header, 0, 4);
+    put(header, zip64 ? Max32 : 0, 4);
+    put(header, zip64 ? Max32 : 0, 4);
+    put(header, name.size(), 2);
+    put(header, zip64 ? 20 : 0, 2);
+    header += name;
+    if(zip64)
+    {
+        put(header, 1, 2);
+        put(header, 16, 2);
+        put(header, 0, 16);
+    }
+    out.write(header.data(), header.size());
+
+    // A few pieces per thread at a time, each ending on a byte boundary so
+    // their output joins into one stream.
+    const std::size_t numPieces = 2*thread_budget();
+    std::vector<std::string> input(numPieces);
+    std::vector<std::string> output(numPieces);
+    for(bool last = false; !last;)
+    {
+        std::size_t n = 0;
+        for(; n < numPieces && !last; ++n)
+        {
+            input[n].resize(PieceSize);
+            in.read(&input[n][0], PieceSize);
+            input[n].resize(static_cast<std::size_t>(in.gcount()));
+            if(in.bad())
+            {
+                throw std::runtime_error("Failed to read \"" + file +
+                    "\" to archive.");
+            }
+            last = in.eof();
+        }
+        parallel_for(n, [&](std::size_t i)
+        {
+            Deflate deflate;
+            output[i].clear();
+            deflate.update(input[i].data(), input[i].size(), output[i]);
+            if(last && i + 1 == n)
+            {
+                deflate.finish(output[i]);
+            }
+            else
+            {
+                deflate.sync(output[i]);
+            }
+        });
+        for(std::size_t i = 0; i < n; ++i)
+        {
+            entry.crc = crc32(input[i].data(), input[i].size(), entry.crc);
+            entry.size += input[i].size();
+            entry.compressedSize += output[i].size();
+            out.write(output[i].data(), output[i].size());
+        }
+    }
+    if(!zip64 && entry.compressedSize > Max32)
+    {
+        throw std::runtime_error("\"" + file + "\" grew while being archived.");
+    }
+
+    const auto end = out.tellp();
+    std::string fields;
+    put(fields, entry.crc, 4);
+    if(!zip64)
+    {
+        put(fields, entry.compressedSize, 4);
+        put(fields, entry.size, 4);
+    }
+    out.seekp(entry.offset + 14);
+    out.write(fields.data(), fields.size());
+    if(zip64)
+    {
+        fields.clear();
+        put(fields, entry.size, 8);
+        put(fields, entry.compressedSize, 8);
+        out.seekp(entry.offset + 34 + name.size());
+        out.write(fields.data(), fields.size());
+    }
+    out.seekp(end);
+    if(!out)
+    {
+        throw std::runtime_error("Failed to write archive \"" + path + "\".");
+    }
+    entries.push_back(std::move(entry));
+}
+
+void pgfplotter::ZipWriter::close()
+{
+    const std::uint64_t start = out.tellp();
+    std::string directory;
+    for(const auto& n : entries)
+    {
+        // Only the fields that don't fit are in the ZIP64 extra field.
+        const bool bigSizes = n.size >= Zip64Size || n.compressedSize > Max32;
+        std::string extra;
+        if(bigSizes)
+        {
+            put(extra, n.size, 8);
+            put(extra, n.compressedSize, 8);
+        }
+        if(n.offset >= Max32)
+        {
+            put(extra, n.offset, 8);
+        }
+        if(!extra.empty())
+        {
+            std::string field;
+            put(field, 1, 2);
+            put(field, extra.size(), 2);
+            extra = field + extra;
+        }
+        const std::uint16_t version = extra.empty() ? 20 : 45;
+        put(directory, 0x02014b50, 4);
+        put(directory, Unix | version, 2);
+        put(directory, version, 2);
+        put(directory, 0, 2);
+        put(directory, 8, 2);
+        put(directory, time, 2);
+        put(directory, date, 2);
+        put(directory, n.crc, 4);
+        put(directory, bigSizes ? Max32 : n.compressedSize, 4);
+        put(directory, bigSizes ? Max32 : n.size, 4);
+        put(directory, n.name.size(), 2);
+        put(directory, extra.size(), 2);
+        put(directory, 0, 6);
+        // Unix permissions 0644.
+        put(directory, 0100644u << 16, 4);
+        put(directory, std::min(n.offset, Max32), 4);
+        directory += n.name + extra;
+    }
+
+    const std::uint64_t size = directory.size();
+    if(entries.size() >= Max16 || start >= Max32 || size >= Max32)
+    {
+        // ZIP64 end of central directory record and its locator.
+        put(directory, 0x06064b50, 4);
+        put(directory, 44, 8);
+        put(directory, Unix | 45, 2);
+        put(directory, 45, 2);
+        put(directory, 0, 8);
+        put(directory, entries.size(), 8);
+        put(directory, entries.size(), 8);
+        put(directory, size, 8);
+        put(directory, start, 8);
+        put(directory, 0x07064b50, 4);
+        put(directory, 0, 4);
+        put(directory, start + size, 8);
+        put(directory, 1, 4);
+    }
+    put(directory, 0x06054b50, 4);
+    put(directory, 0, 4);
+    put(directory, std::min<std::uint64_t>(entries.size(), Max16), 2);
+    put(directory, std::min<std::uint64_t>(entries.size(), Max16), 2);
+    put(directory, std::min(size, Max32), 4);
+    put(directory, std::min(start, Max32), 4);
+    put(directory, 0, 2);
+    out.write(directory.data(), directory.size());
+    out.close();
+    if(!out)
+    {
+        throw std::runtime_error("Failed to write archive \"" + path + "\".");
+    }
+    closed = true;
+}
+
+void pgfplotter::zip_directory(const std::string& dir, const std::string& path)
+{
+    // Sorted, so the archive doesn't depend on directory order.
+    std::map<std::string, std::string> files;
+    for(const auto& n : std::filesystem::directory_iterator(dir))
+    {
+        if(n.is_regular_file())
+        {
+            files[n.path().filename().string()] = n.path().string();
+        }
+    }
+    ZipWriter zip(path);
+    for(const auto& n : files)
+    {
+        zip.add_file(n.first, n.second);
+    }
+    zip.close();
+}
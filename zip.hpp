@@ -0,0 +1,52 @@
+#ifndef PGFPLOTTER_ZIP_HPP
+#define PGFPLOTTER_ZIP_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+
+namespace pgfplotter
+{
+    // Writes a zip archive in one pass, deflating each file in pieces across
+    // up to `thread_budget()` threads. Entries switch to ZIP64 as needed, so
+    // neither files nor the archive are limited to 4 GiB.
+    class ZipWriter
+    {
+        struct Entry
+        {
+            std::string name;
+            std::uint32_t crc;
+            std::uint64_t size;
+            std::uint64_t compressedSize;
+            std::uint64_t offset;
+        };
+
+        std::string path;
+        std::ofstream out;
+        std::vector<Entry> entries;
+        // Modification time of every entry, in MS-DOS format.
+        std::uint16_t time;
+        std::uint16_t date;
+        bool closed = false;
+
+    public:
+        // Throws if `path` can't be opened.
+        explicit ZipWriter(const std::string& path);
+        // Deletes the archive unless it was closed.
+        ~ZipWriter();
+        ZipWriter(const ZipWriter&) = delete;
+        ZipWriter& operator=(const ZipWriter&) = delete;
+
+        // Compresses the file at `file` into the archive as `name`. Throws if
+        // it can't be read or the archive can't be written.
+        void add_file(const std::string& name, const std::string& file);
+        // Writes the central directory. Throws on failure.
+        void close();
+    };
+
+    // Archives the regular files in `dir` by name, in order, at `path`.
+    void zip_directory(const std::string& dir, const std::string& path);
+}
+
+#endif